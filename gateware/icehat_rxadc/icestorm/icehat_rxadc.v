@@ -117,12 +117,14 @@ module icehat_rxadc #(
 	//------------------------------
 	// readback
 	//------------------------------
-	parameter DESIGN_ID = 32'hADC50001;
+	parameter DESIGN_ID = 32'hADC50002;
+	parameter BUILD_HASH = 32'h00000000;	// set by the Makefile
     wire [6:0] sathld;
 	always @(*)
 		case(addr)
 			7'h00: rdat = DESIGN_ID;
 			7'h01: rdat = spi_reg_01;
+			7'h02: rdat = BUILD_HASH;
 			7'h10: rdat = ddc_frq;
 			7'h11: rdat = dac_mux_sel;
 			7'h12: rdat = ddc_ns_ena;
@@ -4,67 +4,121 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include "main.h"
 #include "audio.h"
 #include "audio_lib.h"
+#include "audio_blk.h"
 #include "iir.h"
+#include "iir_kern.h"
 #include "iir_coeffs.h"
+#include "stats.h"
+#include "pfb.h"
+#include "rt.h"
 
-/* sine LUT */
-float32_t sine_lut[256];
-
-/* state for demods */
-float32_t i_dc_acc, q_dc_acc, am_dc_acc;
-float32_t pll_intg, pll_frq, pll_phs;
-float32_t mag_sq;
-float32_t alpha, logR, f_pwr, agc_acc, agc_gain;
-float32_t nbfm_pphs, nbfm_de_acc;
-float32_t rssi;
-float32_t freq_norm;
-int32_t phs, frq;
-uint16_t mute_state, mute_queued, pll_count;
-uint8_t demod_type, pll_state;
-
-/* IIR lowpass filters */
-uint8_t filter_num;
-bq_state i_iir_s[3], q_iir_s[3];
-iir i_iir, q_iir;
-const uint8_t audio_num_filts = NUM_FILTS;
+/* frames handed to the receivers at once - multiple of AUDIO_BLKSZ */
+#define AUDIO_RX_CHUNK 2048
+
+/* biquad sections in every channel filter in iir_coeffs.h */
+#define AUDIO_FILT_BQ 3
+
+/* default AGC times */
+#define AGC_ATTACK_MS 2.0F
+#define AGC_DECAY_MS 500.0F
+#define AGC_HANG_MS 250.0F
 
-/* SSB Hilbert IIRs */
-#define SHIFT_STAGES 6
-const float32_t c_ahi[] =
+typedef struct audio_rx audio_rx;
+
+/* one block through a receiver, specialized per demod & filter order */
+typedef void (*rx_kernel)(audio_rx *rc, int16_t *src, int16_t *dst,
+	float32_t *l, float32_t *r, int n, uint64_t *t);
+
+/* receiver context - one per demodulator on the shared I/Q stream */
+struct audio_rx
 {
-	0.5131884F,
-	0.8133175F,
-	0.9359722F,
-	0.9791145F,
-	0.9934793F,
-	0.9989305F
-};
-	
-const float32_t c_alo[] =
-{
-	0.2755710F,
-	0.6922636F,
-	0.8896328F,
-	0.9633075F,
-	0.9882633F,
-	0.9965990F
-};
-float32_t ahi[SHIFT_STAGES], alo[SHIFT_STAGES];
-struct
-{	
-	/* Allpass state */
-	float32_t state_hi_i[SHIFT_STAGES][2];
-	float32_t state_hi_o[SHIFT_STAGES][2], dly;
-	float32_t state_lo_i[SHIFT_STAGES][2];
-	float32_t state_lo_o[SHIFT_STAGES][2];
-	
-	/* DC block state */
-	float32_t lo_dc, hi_dc;
-	
-} fb;
+	rx_kernel kernel;				/* used for the current buffer */
+	_Atomic(rx_kernel) kernel_req;	/* set by the command thread */
+	_Atomic uint8_t enable_req;		/* set by the command thread */
+	_Atomic uint8_t reset_req;		/* clear the DSP state on enable */
+	uint8_t enable;					/* used for the current buffer */
+	uint8_t demod_type;
+	uint8_t filter_num;
+	uint8_t phase_det;
+	uint16_t mute_state;
+	float32_t level;				/* output mix gain */
+	int32_t offset;					/* fine tune in Hz */
+	float32_t nco_phs, nco_frq;		/* cycles, cycles/sample */
+
+	/* DC blocks */
+	float32_t i_dc_acc, q_dc_acc, am_dc_acc;
+
+	/* AGC */
+	blk_agc_state agc;
+	float32_t agc_attack, agc_decay, agc_hang;	/* ms */
+	_Atomic uint8_t agc_req;		/* new times for the audio thread */
+
+	/* input power totals - seqlock, odd while the audio thread updates */
+	_Atomic uint32_t pwr_seq;
+	double pwr_sum;
+	uint64_t pwr_n;
+
+	/* detectors */
+	blk_pll pll;
+	blk_hilbert fb;
+	blk_nbfm nbfm;
+
+	/* IIR lowpass filters */
+	bq_state i_iir_s[AUDIO_FILT_BQ], q_iir_s[AUDIO_FILT_BQ];
+	iir i_iir, q_iir;
+
+	/* block scratch & demodulated output for one chunk */
+	float32_t blk_i[AUDIO_BLKSZ] BLK_ALIGN, blk_q[AUDIO_BLKSZ] BLK_ALIGN;
+	float32_t blk_mag[AUDIO_BLKSZ] BLK_ALIGN;
+	float32_t l[AUDIO_RX_CHUNK] BLK_ALIGN, r[AUDIO_RX_CHUNK] BLK_ALIGN;
+} __attribute__ ((aligned (64)));
+
+/* receiver worker thread */
+typedef struct
+{
+	pthread_t thread;
+	sem_t go;
+	int id;
+} rx_worker;
+
+audio_rx rx[AUDIO_MAX_RX];
+const uint8_t audio_num_filts = NUM_FILTS;
+
+/* receivers active for the current buffer, [0] runs on the caller */
+audio_rx *rx_active[AUDIO_MAX_RX];
+int rx_num_active;
+
+/* worker pool & the chunk they're working on */
+rx_worker rx_workers[AUDIO_MAX_RX-1];
+atomic_int rx_num_workers;
+int rx_stride;
+sem_t rx_done;
+int16_t *rx_src;
+int rx_frames;
+
+/* receiver mix */
+float32_t mix_l[AUDIO_RX_CHUNK] BLK_ALIGN, mix_r[AUDIO_RX_CHUNK] BLK_ALIGN;
+
+/* raw I/Q capture - armed by another thread, filled by the audio thread */
+int16_t *cap_buf;
+int cap_frames, cap_fill, cap_ready;
+atomic_int cap_armed;
+sem_t cap_done;
+
+/* recent raw I/Q - the audio thread overwrites, readers check it didn't */
+int16_t snap_buf[2*AUDIO_SNAP_LEN];
+atomic_uint snap_head, snap_wr;		/* frames written, being written */
+atomic_int snap_on;
 
 const char *audio_demod_names[] =
 {
@@ -84,80 +138,96 @@ const char *audio_sync_names[] =
 	"NARROW",
 };
 
+const char *audio_phase_names[] =
+{
+	"LIBM",
+	"POLY",
+	"QUAD",
+};
+
+static void Audio_RxSetKernel(audio_rx *r);
 
-#define DC_SCALE (1.0F/1000.0F)
-#define PLL_P_WIDE 1.0e-3F
-#define PLL_I_WIDE 1.0e-6F
-#define PLL_P_NARR 5.0e-6F
-#define PLL_I_NARR 1.0e-8F
-#define PLL_LOCK_THRESH 0.01F
-#define NBFM_DEV_SCL ((19531.25F/2500.0F)/(2.0F*PI))
-#define NBFM_DE_SCALE ((2.0F*PI*300)/19531.25F)
 /*
- * init audio
+ * one receiver's settings to defaults - command thread
  */
-void Audio_Init(void)
+static void Audio_RxDefaults(audio_rx *r)
+{
+	r->phase_det = PHASE_LIBM;
+	r->filter_num = 0;
+
+	/* AGC times, picked up at the next buffer */
+	r->agc_attack = AGC_ATTACK_MS;
+	r->agc_decay = AGC_DECAY_MS;
+	r->agc_hang = AGC_HANG_MS;
+	atomic_store_explicit(&r->agc_req, 1, memory_order_release);
+
+	/* Init Demod Mode */
+	r->demod_type = 0; /* 0 =AM */
+	Audio_RxSetKernel(r);
+
+	/* centered at unity gain */
+	r->offset = 0;
+	r->level = 1.0F;
+}
+
+/*
+ * clear one receiver's DSP state - audio thread, before the receiver
+ * joins a buffer
+ */
+static void Audio_RxReset(audio_rx *r)
 {
-	int16_t i;
-	
-	/* fill the sine LUT */
-	for(i=0;i<256;i++)
-		sine_lut[i] = sinf(2.0F*PI*(float32_t)i/256.0F);
+	uint8_t filter = r->filter_num * AUDIO_FILT_BQ;
 
 	/* setup input DC block */
-	i_dc_acc = q_dc_acc = am_dc_acc = 0.0F;
-    
+	r->i_dc_acc = r->q_dc_acc = r->am_dc_acc = 0.0F;
+
     /* init the sync AM pll */
-    pll_phs = 0.0F;
-    pll_intg = 0.0F;
-	pll_state = 0;
-    pll_count = 0;
-    
+    r->pll.phs = 0.0F;
+    r->pll.intg = 0.0F;
+	r->pll.state = 0;
+    r->pll.count = 0;
+
     /* Narrowband FM state */
-    nbfm_pphs = nbfm_de_acc = 0.0F;
-    
+    r->nbfm.pphs = r->nbfm.de_acc = 0.0F;
+	r->nbfm.pi = r->nbfm.pq = 0.0F;
+
 	/* setup the IIR filters */
-	Audio_SetFilter(0);
-	
+	iir_init(&r->i_iir, r->i_iir_s, (bq_coeffs *)&c[filter], AUDIO_FILT_BQ);
+	iir_init(&r->q_iir, r->q_iir_s, (bq_coeffs *)&c[filter], AUDIO_FILT_BQ);
+
 	/* init the AGC */
-	logR = logf(0.01F);
-	f_pwr = 0.0F;
-	agc_acc = 0.0F;
-	agc_gain = 1.0F;
-
-	/* init the signal strength */
-	rssi = 1.0F;
-	
+	blk_agc_init(&r->agc);
+
 	/* set up SSB demod */
-	/* compute the allpass coeffs */
-	for(i=0;i<SHIFT_STAGES;i++)
-	{
-		ahi[i] = c_ahi[i]*c_ahi[i];
-		alo[i] = c_alo[i]*c_alo[i];
-	}
+	blk_hilbert_init(&r->fb);
+
+	/* Init mute state */
+	r->mute_state = 0;
+
+	r->nco_phs = r->nco_frq = 0.0F;
+}
+
+/*
+ * init audio
+ */
+void Audio_Init(void)
+{
+	uint8_t i;
+
+	/* shared tables */
+	blk_init();
 
-	/* clear allpass state memory */
-	for(i=0;i<SHIFT_STAGES;i++)
+	/* receiver 0 is always on */
+	for(i=0;i<AUDIO_MAX_RX;i++)
 	{
-		fb.state_hi_i[i][0] = 0.0F;
-		fb.state_hi_i[i][1] = 0.0F;
-		fb.state_hi_o[i][0] = 0.0F;
-		fb.state_hi_o[i][1] = 0.0F;
-		fb.state_lo_i[i][0] = 0.0F;
-		fb.state_lo_i[i][1] = 0.0F;
-		fb.state_lo_o[i][0] = 0.0F;
-		fb.state_lo_o[i][1] = 0.0F;
+		Audio_RxReset(&rx[i]);
+		Audio_RxDefaults(&rx[i]);
+		rx[i].enable = (i == 0);
+		atomic_store(&rx[i].enable_req, rx[i].enable);
 	}
-	fb.dly = 0.0F;
-	
-	/* init DC blocks */
-	fb.lo_dc = fb.hi_dc = 0.0F;
-	
-	/* Init mute state */
-	mute_state = 0;
-	
-	/* Init Demod Mode */
-	demod_type = 0; /* 0 =AM */
+
+	/* channelizer off */
+	pfb_init();
 }
 
 /*
@@ -165,15 +235,7 @@ void Audio_Init(void)
  */
 void Audio_SetFilter(uint8_t filter)
 {
-    filter_num = filter;
-    
-	/* compute coeff index */
-	filter_num = (filter_num > NUM_FILTS-1) ? NUM_FILTS-1 : filter_num;
-	filter = filter_num * 3;
-	
-	/* init the filters with specified filter */
-	iir_init(&i_iir, i_iir_s, (bq_coeffs *)&c[filter], 3);
-	iir_init(&q_iir, q_iir_s, (bq_coeffs *)&c[filter], 3);
+	Audio_RxSetFilter(0, filter);
 }
 
 /*
@@ -181,7 +243,7 @@ void Audio_SetFilter(uint8_t filter)
  */
 uint8_t Audio_GetFilter(void)
 {
-    return filter_num;
+    return rx[0].filter_num;
 }
 
 /*
@@ -190,20 +252,16 @@ uint8_t Audio_GetFilter(void)
 uint32_t Audio_GetFilterBW(uint8_t filter_num)
 {
 	float32_t actual_sr = sample_rate * 12.5F / 12.0F;
-	
+
 	return floorf(fbw[filter_num]*actual_sr + 0.5);
 }
 
 /*
  * Get RSSI
- * Calibrated for 200mVpp @ RXADC input = -10dBm
  */
 int16_t Audio_GetRSSI(void)
 {
-	int16_t rssi_dBm;
-    float32_t temp = 1.0F/agc_gain;
-    rssi_dBm = 10.0F*log10f(temp*temp)-24.0F;
-    return rssi_dBm;
+	return Audio_RxGetRSSI(0);
 }
 
 /*
@@ -211,7 +269,7 @@ int16_t Audio_GetRSSI(void)
  */
 void Audio_SetDemod(uint8_t demod)
 {
-	demod_type = demod % DEMOD_MAX;
+	Audio_RxSetDemod(0, demod);
 }
 
 /*
@@ -219,7 +277,7 @@ void Audio_SetDemod(uint8_t demod)
  */
 int8_t Audio_GetDemod(void)
 {
-	return demod_type;
+	return rx[0].demod_type;
 }
 
 /*
@@ -227,29 +285,31 @@ int8_t Audio_GetDemod(void)
  */
 void Audio_SetMute(uint8_t State)
 {
+	uint16_t *mute_state = &rx[0].mute_state;
+
 	if(State==0)
 	{
 		/* want unmute */
-		if(mute_state == 512)
+		if(*mute_state == 512)
 		{
 			/* currently muted, so start ramping up */
-			mute_state = 0;
+			*mute_state = 0;
 		}
 	}
 	else
 	{
 		/* want mute */
-		if(mute_state == 256)
+		if(*mute_state == 256)
 		{
 			/* currently unmuted, so start ramping down */
-			mute_state++;
+			(*mute_state)++;
 		}
 	}
 }
 
 uint16_t Audio_GetMute(void)
 {
-	return mute_state;
+	return rx[0].mute_state;
 }
 
 /*
@@ -257,7 +317,7 @@ uint16_t Audio_GetMute(void)
  */
 int16_t Audio_GetParam(void)
 {
-    return 1000*am_dc_acc;
+    return 1000*rx[0].am_dc_acc;
 }
 
 /*
@@ -266,7 +326,7 @@ int16_t Audio_GetParam(void)
 int16_t Audio_GetSyncFrq(void)
 {
 	float32_t actual_sr = sample_rate * 12.5F / 12.0F;
-    return (int16_t)(pll_frq*actual_sr+0.5F);
+    return (int16_t)(rx[0].pll.frq*actual_sr+0.5F);
 }
 
 /*
@@ -274,307 +334,686 @@ int16_t Audio_GetSyncFrq(void)
  */
 int16_t Audio_GetSyncSt(void)
 {
-    return pll_state;
+    return rx[0].pll.state;
 }
 
+static void Audio_RxProcess(audio_rx *r, int16_t *src, int16_t *dst, int n,
+	uint64_t *t);
+
 /*
- * interpolating LUT-based sine wavetable
+ * receiver worker - runs its share of the active receivers each chunk
  */
-float32_t sine_wave(float32_t phs)
+static void *Audio_RxWorker(void *ptr)
 {
-    float32_t iphs;
-    phs = modff(phs, &iphs); /* modulo 1.0 */
-	phs *= 256.0F;
-	uint32_t phs_int = (uint32_t)phs;
-	float32_t phs_frac = phs - (float32_t)phs_int;
-	float32_t result = sine_lut[phs_int]*(1.0F-phs_frac);
-	return result + sine_lut[(phs_int+1)&0xFF]*phs_frac;
+	rx_worker *w = (rx_worker *)ptr;
+	int k;
+
+	while(1)
+	{
+		sem_wait(&w->go);
+		for(k=1+w->id;k<rx_num_active;k+=rx_stride)
+			Audio_RxProcess(rx_active[k], rx_src, NULL, rx_frames, NULL);
+		sem_post(&rx_done);
+	}
+
+	return NULL;
 }
 
 /*
- * process the audio
+ * start one worker per spare core
  */
-void Audio_Process(char *rdbuf, int inframes)
+static void Audio_RxStartWorkers(void)
 {
-	int16_t *src = (int16_t *)rdbuf;
-	int16_t *dst = src;
-	uint16_t index, m;
-	float32_t i_in, q_in;
-	float32_t i_dcb, q_dcb;
-	float32_t i_filter, q_filter;
-	float32_t am_raw, am_dcb;
-	float32_t hilb_in, hilb_out;
-	float32_t ap_i, ap_q;
-	float32_t ssb_i, ssb_q;
-	float32_t i_det = 0.0F, q_det = 0.0F;
-	float32_t mute_gain, i_mute, q_mute;
-	
-	/* scale AGC response time */
-	alpha = 0.001F * (float32_t)inframes / 64.0F;
-    
-	/* process I2S data */
-	for(index=0;index<inframes;index++)
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+
+	if(rx_num_workers || cores < 2)
+		return;
+
+	cores = cores > AUDIO_MAX_RX ? AUDIO_MAX_RX : cores;
+	sem_init(&rx_done, 0, 0);
+	for(i=0;i<cores-1;i++)
 	{
-		/* get input from FPGA & convert to float */
-		i_in = (float32_t)*src++/32768.0F;
-		q_in = (float32_t)*src++/32768.0F;
-
-		/* Input DC blocker ------------------------ */
-		i_dcb = i_in - i_dc_acc;
-		i_dc_acc += (i_dcb * DC_SCALE);
-		q_dcb = q_in - q_dc_acc;
-		q_dc_acc += (q_dcb * DC_SCALE);
-		
-        if((demod_type==0)||(demod_type==1))
-        {
-            /* bypass for AM to avoid distortion when carrier @ DC */
-            i_dcb = i_in;
-            q_dcb = q_in;
-        }
-        
-		/* filter ---------------------------------- */
-		i_filter = iir_calc(&i_iir, i_dcb);
-		q_filter = iir_calc(&q_iir, q_dcb);
-		
-		/* AGC  -------------------------------------*/
-		i_filter = i_filter * agc_gain;
-		q_filter = q_filter * agc_gain;
-		mag_sq = i_filter*i_filter + q_filter*q_filter;
-#if 0
-        /* single slope */
-		f_pwr = 0.99*f_pwr + 0.01*mag_sq;
-#else
-        /* dual slope */
-        if(f_pwr > mag_sq)
-            /* decay */
-            f_pwr = 0.99F * f_pwr + 0.01F * mag_sq;
-        else
-            /* attack 10x faster */
-            f_pwr = 0.8F * f_pwr + 0.2F * mag_sq;
-#endif
-		/*
-		 * detector - one of
-		 *  0 AM (mag)
-		 *  1 Sync AM (mix w/ PLL)
-		 *  2 SSB upper (phasing)
-		 *  3 SSB lower (phasing)
-		 *  4 SSB upper + lower (phasing)
-         *  5 raw I&Q with filter
-		 */
-		switch(demod_type)
-		{
-			case DEMOD_AM:
-			case DEMOD_SYNC_AM:
-				if(demod_type == DEMOD_AM)
-                {
-                    /* AM mag detector */
-                    am_raw = sqrtf(mag_sq);
-                }
-                else
-                {
-                    /* AM Sync detector */
-                    float32_t pll_i_lo, pll_q_lo, pll_i_bb, pll_q_bb, pll_err;
-                    
-                    /* get LO */
-                    pll_i_lo = sine_wave(pll_phs+0.25F);
-                    pll_q_lo = sine_wave(pll_phs);
-                    
-                    /* conjugate mix down */
-                    pll_i_bb = i_filter * pll_i_lo + q_filter * pll_q_lo;
-                    pll_q_bb = q_filter * pll_i_lo - i_filter * pll_q_lo;
-                    
-                    /* error is angle or imag of baseband */
-                    pll_err = atan2f(pll_q_bb, pll_i_bb);
-                    
-                    /* check for DC estimate ramp up after PLL lock */
-                    if((pll_state == 0) && (am_dc_acc >= PLL_LOCK_THRESH))
-                    {
-                        /* Start timer */
-                        pll_state = 1;
-                        pll_count = 5000;
-                    }
-                    
-                    /* Reset BW if lost lock */
-                    if((pll_state == 2) && (am_dc_acc < (PLL_LOCK_THRESH/2.0F)))
-                        pll_state = 0;
-                    
-                    /* timeout? */
-                    if(pll_state == 1)
-                    {
-                        if(pll_count == 0)
-                            pll_state = 2;
-                        else
-                            pll_count = pll_count - 1;
-                    }
-                    
-                    /* loop filter */
-                    if(pll_state != 2)
-                    {
-                        /* Wide bandwidth */
-                        pll_frq = pll_intg + PLL_P_WIDE * pll_err;
-                        pll_intg += PLL_I_WIDE * pll_err;
-                        
-                        /* output normal demod */
-                        am_raw = sqrtf(mag_sq);
-                    }
-                    else
-                    {
-                        /* Narrow bandwidth */
-                        pll_frq = pll_intg + PLL_P_NARR * pll_err;
-                        pll_intg += PLL_I_NARR * pll_err;
-                        
-                        /* output Sync demod */
-                        am_raw = pll_i_bb;
-                    }
-                    
-                    /* nco */
-                    pll_phs += pll_frq;
-                    if(pll_phs > 1.0F)
-                        pll_phs -=1.0F;
-                    else if(pll_phs < 0.0F)
-                        pll_phs += 1.0F;
-                }
-                
-				/* AM DC Block */
-				am_dcb = am_raw - am_dc_acc;
-				am_dc_acc += (am_dcb * DC_SCALE);
-				
-				/* output with makeup gain */
-				i_det = 2.0F * am_dcb;
-                q_det = i_det;
-				break;
-			
-			case DEMOD_USB:
-			case DEMOD_LSB:
-			case DEMOD_ULSB:
-				/* Hi filters */
-				hilb_in = i_filter;
-				for(m=0;m<SHIFT_STAGES;m++)
-				{
-					/* compute AP */
-					hilb_out = ahi[m]*(hilb_in+fb.state_hi_o[m][1])-fb.state_hi_i[m][1];
-					
-					/* advance delays */
-					fb.state_hi_i[m][1] = fb.state_hi_i[m][0];
-					fb.state_hi_i[m][0] = hilb_in;
-					fb.state_hi_o[m][1] = fb.state_hi_o[m][0];
-					fb.state_hi_o[m][0] = hilb_out;
-					
-					/* input for next AP = out from current */
-					hilb_in = hilb_out;
-				}
-				
-				/* one sample delay on hi side output */
-				ap_i = fb.dly;
-				fb.dly = hilb_out;
-				
-				/* Lo filters */
-				hilb_in = q_filter;
-				for(m=0;m<SHIFT_STAGES;m++)
-				{
-					/* compute AP */
-					hilb_out = alo[m]*(hilb_in+fb.state_lo_o[m][1])-fb.state_lo_i[m][1];
-					
-					/* advance delays */
-					fb.state_lo_i[m][1] = fb.state_lo_i[m][0];
-					fb.state_lo_i[m][0] = hilb_in;
-					fb.state_lo_o[m][1] = fb.state_lo_o[m][0];
-					fb.state_lo_o[m][0] = hilb_out;
-					
-					/* input for next AP = out from current */
-					hilb_in = hilb_out;
-				}
-				ap_q = hilb_out;
-				
-				/* SSB DC blocks */
-				ssb_i = ap_i - fb.hi_dc;
-				fb.hi_dc += (ssb_i * DC_SCALE);
-				ssb_q = ap_q - fb.lo_dc;
-				fb.lo_dc += (ssb_q * DC_SCALE);
-				
-				/* choose sideband for output */
-				if(demod_type == DEMOD_USB)
-					i_det = q_det = ssb_i - ssb_q;	/* upper */
-				else if(demod_type == DEMOD_LSB)
-					i_det = q_det = ssb_i + ssb_q;	/* lower */
-				else if(demod_type == DEMOD_ULSB)
-				{
-                    i_det = ssb_i - ssb_q;	/* upper */
-                    q_det = ssb_i + ssb_q;	/* lower */
-                }
-				break;
-            
-            case DEMOD_NBFM:
-                {
-                    float32_t nbfm_phs, nbfm_raw, nbfm_out;
-                    
-                    /* get phase */
-                    nbfm_phs = atan2f(i_filter, q_filter);
-                    
-                    /* differentiate */
-                    nbfm_raw = nbfm_phs - nbfm_pphs;
-                    nbfm_pphs = nbfm_phs;
-                    
-                    /* unwrap */
-                    if(nbfm_raw > PI)
-                        nbfm_raw -= 2.0*PI;
-                    else if(nbfm_raw < -PI)
-                        nbfm_raw += 2.0*PI;
-                    
-                    /* deviation adj to 10% full scale */
-                    nbfm_raw *= (NBFM_DEV_SCL/10.0F);
-                    
-#if 1
-                    /* de-emphasis with leak */
-                    nbfm_de_acc = (nbfm_de_acc*0.99F) + nbfm_raw;
-                    nbfm_out = nbfm_de_acc * NBFM_DE_SCALE;
-#else
-                    /* no de-emphasis */
-                    nbfm_out = nbfm_raw;
-#endif
-
-                    i_det = q_det = nbfm_out;
-                }
-                break;
-                
-            case DEMOD_RAW:
-				/* raw I & Q with AGC & filter */
-                i_det = i_filter;
-                q_det = q_filter;
-				break;
-                
-		}	
-		
-		/* Muting */
-		mute_gain = 0.0F;
-		if(mute_state<256)
+		rx_workers[i].id = i;
+		sem_init(&rx_workers[i].go, 0, 0);
+		/* same priority as the audio thread but kept off its core */
+		if(rt_thread_create(&rx_workers[i].thread, Audio_RxWorker,
+			&rx_workers[i], RT_PIN_AWAY))
 		{
-			/* ramping up */
-			mute_gain = (float32_t)mute_state/256.0F;
-			mute_state++;
+			fprintf(stderr, "Audio_RxStartWorkers: only %d of %ld workers started\n",
+				i, cores-1);
+			break;
 		}
-		else if(mute_state == 256)
+	}
+	atomic_store_explicit(&rx_num_workers, i, memory_order_release);
+}
+
+/*
+ * touch all the receiver state so the audio thread never page faults
+ */
+void Audio_Prefault(void)
+{
+	rt_prefault(rx, sizeof(rx));
+	rt_prefault(mix_l, sizeof(mix_l));
+	rt_prefault(mix_r, sizeof(mix_r));
+}
+
+/*
+ * grab the next frames of raw I/Q into buf - returns right away,
+ * Audio_CaptureWait() says when they're there
+ */
+void Audio_CaptureStart(int16_t *buf, int frames)
+{
+	if(!cap_ready)
+	{
+		sem_init(&cap_done, 0, 0);
+		cap_ready = 1;
+	}
+	while(sem_trywait(&cap_done) == 0)
+		;
+	cap_buf = buf;
+	cap_frames = frames;
+	cap_fill = 0;
+	atomic_store_explicit(&cap_armed, 1, memory_order_release);
+}
+
+/*
+ * wait for a capture - returns 1 & disarms on timeout
+ */
+int Audio_CaptureWait(int timeout_ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if(ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	while(sem_timedwait(&cap_done, &ts) == -1)
+	{
+		if(errno == EINTR)
+			continue;
+		atomic_store_explicit(&cap_armed, 0, memory_order_relaxed);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * audio thread side of the capture
+ */
+static void Audio_CaptureTap(const int16_t *src, int frames)
+{
+	int n;
+
+	if(!atomic_load_explicit(&cap_armed, memory_order_acquire))
+		return;
+
+	n = cap_frames - cap_fill;
+	n = frames < n ? frames : n;
+	memcpy(&cap_buf[2*cap_fill], src, 2*n*sizeof(int16_t));
+	cap_fill += n;
+	if(cap_fill == cap_frames)
+	{
+		atomic_store_explicit(&cap_armed, 0, memory_order_relaxed);
+		sem_post(&cap_done);
+	}
+}
+
+/*
+ * keep the recent I/Q going for Audio_Snapshot()
+ */
+void Audio_SnapEnable(int on)
+{
+	atomic_store_explicit(&snap_on, on, memory_order_relaxed);
+}
+
+/*
+ * latest frames of I/Q into buf - returns 1 if the audio thread wrote
+ * over them while they were being copied, try again
+ */
+int Audio_Snapshot(int16_t *buf, int frames)
+{
+	unsigned int h0, h1, pos, n;
+
+	if(frames > AUDIO_SNAP_LEN/2)
+		return 1;
+
+	h0 = atomic_load_explicit(&snap_head, memory_order_acquire);
+	pos = (h0 - frames) & (AUDIO_SNAP_LEN-1);
+	n = AUDIO_SNAP_LEN - pos;
+	n = n < (unsigned int)frames ? n : (unsigned int)frames;
+	memcpy(buf, &snap_buf[2*pos], 2*n*sizeof(int16_t));
+	memcpy(&buf[2*n], snap_buf, 2*(frames-n)*sizeof(int16_t));
+	atomic_thread_fence(memory_order_acquire);
+	h1 = atomic_load_explicit(&snap_wr, memory_order_relaxed);
+
+	return (h1 - h0) > (unsigned int)(AUDIO_SNAP_LEN - frames);
+}
+
+/*
+ * audio thread side of the snapshot
+ */
+static void Audio_SnapTap(const int16_t *src, int frames)
+{
+	unsigned int h, pos, n;
+
+	if(!atomic_load_explicit(&snap_on, memory_order_relaxed))
+		return;
+
+	/* only the last AUDIO_SNAP_LEN frames matter */
+	if(frames > AUDIO_SNAP_LEN)
+	{
+		src += 2*(frames - AUDIO_SNAP_LEN);
+		frames = AUDIO_SNAP_LEN;
+	}
+
+	h = atomic_load_explicit(&snap_head, memory_order_relaxed);
+	atomic_store_explicit(&snap_wr, h + frames, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	pos = h & (AUDIO_SNAP_LEN-1);
+	n = AUDIO_SNAP_LEN - pos;
+	n = n < (unsigned int)frames ? n : (unsigned int)frames;
+	memcpy(&snap_buf[2*pos], src, 2*n*sizeof(int16_t));
+	memcpy(snap_buf, &src[2*n], 2*(frames-n)*sizeof(int16_t));
+	atomic_store_explicit(&snap_head, h + frames, memory_order_release);
+}
+
+/*
+ * number of receiver worker threads
+ */
+int Audio_RxWorkers(void)
+{
+	return atomic_load(&rx_num_workers);
+}
+
+/*
+ * turn a receiver on or off - receiver 0 stays on. The audio thread
+ * clears its state & adds it at the start of the next buffer, so a
+ * worker still running it from the current one isn't disturbed.
+ */
+void Audio_RxEnable(uint8_t n, uint8_t enable)
+{
+	enable = enable != 0;
+	if(n == 0 || n >= AUDIO_MAX_RX || atomic_load(&rx[n].enable_req) == enable)
+		return;
+
+	if(enable)
+	{
+		Audio_RxStartWorkers();
+		Audio_RxDefaults(&rx[n]);
+		atomic_store_explicit(&rx[n].reset_req, 1, memory_order_relaxed);
+	}
+	atomic_store_explicit(&rx[n].enable_req, enable, memory_order_release);
+}
+
+uint8_t Audio_RxGetEnable(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? atomic_load(&rx[n].enable_req) : 0;
+}
+
+/*
+ * per-receiver demodulator
+ */
+void Audio_RxSetDemod(uint8_t n, uint8_t demod)
+{
+	if(n < AUDIO_MAX_RX)
+	{
+		rx[n].demod_type = demod % DEMOD_MAX;
+		Audio_RxSetKernel(&rx[n]);
+	}
+}
+
+int8_t Audio_RxGetDemod(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? rx[n].demod_type : -1;
+}
+
+/*
+ * per-receiver filter index
+ */
+void Audio_RxSetFilter(uint8_t n, uint8_t filter)
+{
+	audio_rx *r;
+
+	if(n >= AUDIO_MAX_RX)
+		return;
+	r = &rx[n];
+
+	/* compute coeff index */
+	r->filter_num = (filter > NUM_FILTS-1) ? NUM_FILTS-1 : filter;
+	filter = r->filter_num * AUDIO_FILT_BQ;
+
+	/* init the filters with specified filter */
+	iir_init(&r->i_iir, r->i_iir_s, (bq_coeffs *)&c[filter], AUDIO_FILT_BQ);
+	iir_init(&r->q_iir, r->q_iir_s, (bq_coeffs *)&c[filter], AUDIO_FILT_BQ);
+	Audio_RxSetKernel(r);
+}
+
+uint8_t Audio_RxGetFilter(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? rx[n].filter_num : 0;
+}
+
+/*
+ * per-receiver fine tune offset from the LO, limited to the passband
+ */
+void Audio_RxSetOffset(uint8_t n, int32_t hz)
+{
+	int32_t lim = sample_rate * 12.5F / 24.0F;
+
+	if(n >= AUDIO_MAX_RX)
+		return;
+
+	hz = hz > lim ? lim : hz;
+	hz = hz < -lim ? -lim : hz;
+	rx[n].offset = hz;
+}
+
+int32_t Audio_RxGetOffset(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? rx[n].offset : 0;
+}
+
+/*
+ * per-receiver phase detector for Sync AM & NBFM
+ */
+void Audio_RxSetPhaseDet(uint8_t n, uint8_t phase)
+{
+	if(n < AUDIO_MAX_RX)
+		rx[n].phase_det = phase % PHASE_MAX;
+}
+
+uint8_t Audio_RxGetPhaseDet(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? rx[n].phase_det : 0;
+}
+
+/*
+ * per-receiver AGC attack, decay & hang times in ms. Applied by the
+ * audio thread at the start of the next buffer.
+ */
+void Audio_RxSetAGC(uint8_t n, float32_t attack_ms, float32_t decay_ms,
+	float32_t hang_ms)
+{
+	if(n >= AUDIO_MAX_RX)
+		return;
+	rx[n].agc_attack = attack_ms < 0.0F ? 0.0F : attack_ms;
+	rx[n].agc_decay = decay_ms < 0.0F ? 0.0F : decay_ms;
+	rx[n].agc_hang = hang_ms < 0.0F ? 0.0F : hang_ms;
+	atomic_store_explicit(&rx[n].agc_req, 1, memory_order_release);
+}
+
+void Audio_RxGetAGC(uint8_t n, float32_t *attack_ms, float32_t *decay_ms,
+	float32_t *hang_ms)
+{
+	if(n >= AUDIO_MAX_RX)
+		n = 0;
+	*attack_ms = rx[n].agc_attack;
+	*decay_ms = rx[n].agc_decay;
+	*hang_ms = rx[n].agc_hang;
+}
+
+/*
+ * per-receiver output level
+ */
+void Audio_RxSetLevel(uint8_t n, float32_t level)
+{
+	if(n < AUDIO_MAX_RX)
+		rx[n].level = level;
+}
+
+float32_t Audio_RxGetLevel(uint8_t n)
+{
+	return n < AUDIO_MAX_RX ? rx[n].level : 0.0F;
+}
+
+/*
+ * Get RSSI
+ * Calibrated for 200mVpp @ RXADC input = -10dBm
+ */
+int16_t Audio_RxGetRSSI(uint8_t n)
+{
+	int16_t rssi_dBm;
+    float32_t temp;
+
+	if(n >= AUDIO_MAX_RX)
+		return 0;
+
+	temp = 1.0F/rx[n].agc.gain;
+    rssi_dBm = 10.0F*log10f(temp*temp)-24.0F;
+    return rssi_dBm;
+}
+
+/*
+ * snapshot of a receiver's input power totals
+ */
+void Audio_RxGetPower(uint8_t n, audio_pwr *p)
+{
+	uint32_t s0, s1;
+
+	p->sum = 0.0;
+	p->n = 0;
+	if(n >= AUDIO_MAX_RX)
+		return;
+
+	do
+	{
+		s0 = atomic_load_explicit(&rx[n].pwr_seq, memory_order_acquire);
+		p->sum = rx[n].pwr_sum;
+		p->n = rx[n].pwr_n;
+		atomic_thread_fence(memory_order_acquire);
+		s1 = atomic_load_explicit(&rx[n].pwr_seq, memory_order_relaxed);
+	}
+	while((s0 & 1) || (s0 != s1));
+}
+
+/*
+ * average input power between two snapshots, same scale as the RSSI
+ */
+float32_t Audio_PowerDB(const audio_pwr *a, const audio_pwr *b)
+{
+	double p;
+
+	if(b->n <= a->n)
+		return -200.0F;
+	p = (b->sum - a->sum) / (double)(b->n - a->n);
+	return p > 1e-20 ? 10.0F*log10f(p/AGC_REF)-24.0F : -200.0F;
+}
+
+/*
+ * only the receiver on the calling thread is timed
+ */
+static inline void rx_mark(int stage, uint64_t *t)
+{
+	if(t)
+		stats_mark(stage, t);
+}
+
+/*
+ * add the AGC's input power for the last block to the totals
+ */
+static inline void Audio_RxAddPower(audio_rx *rc, int n)
+{
+	uint32_t s = atomic_load_explicit(&rc->pwr_seq, memory_order_relaxed);
+
+	atomic_store_explicit(&rc->pwr_seq, s+1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	rc->pwr_sum += rc->agc.pwr;
+	rc->pwr_n += n;
+	atomic_store_explicit(&rc->pwr_seq, s+2, memory_order_release);
+}
+
+/*
+ * process one block of up to AUDIO_BLKSZ frames into l & r. If dst is
+ * given the result also goes out as S16 - src & dst may be equal.
+ * Only expanded through RX_KERNEL() so demod & nbq are constants and
+ * the detector choice and filter loop are resolved at compile time.
+ */
+static inline __attribute__ ((always_inline)) void Audio_ProcessBlk(
+	audio_rx *rc, int16_t *src, int16_t *dst, float32_t *l, float32_t *r,
+	int n, uint64_t *t, const uint8_t demod, const uint8_t nbq)
+{
+	uint8_t am_bypass;
+
+	/* get input from FPGA & convert to float */
+	blk_s16_to_iq(src, rc->blk_i, rc->blk_q, n);
+	rx_mark(STAGE_CONVERT, t);
+
+	/* Input DC blocker - bypass for AM to avoid distortion when carrier @ DC */
+	am_bypass = (demod==DEMOD_AM)||(demod==DEMOD_SYNC_AM);
+	blk_dc_block(rc->blk_i, &rc->i_dc_acc, n, am_bypass);
+	blk_dc_block(rc->blk_q, &rc->q_dc_acc, n, am_bypass);
+
+	/* fine tune */
+	if(rc->offset)
+		blk_nco(rc->blk_i, rc->blk_q, &rc->nco_phs, rc->nco_frq, n);
+	rx_mark(STAGE_DCBLOCK, t);
+
+	/* filter */
+	iir_iq_cascade(rc->i_iir.bqc, nbq, rc->i_iir.bqs->state,
+		rc->q_iir.bqs->state, rc->blk_i, rc->blk_q, n, 1);
+	rx_mark(STAGE_FILTER, t);
+
+	/* AGC */
+	blk_agc(&rc->agc, rc->blk_i, rc->blk_q, rc->blk_mag, n);
+	Audio_RxAddPower(rc, n);
+	rx_mark(STAGE_AGC, t);
+
+	/*
+	 * detector - one of
+	 *  0 AM (mag)
+	 *  1 Sync AM (mix w/ PLL)
+	 *  2 SSB upper (phasing)
+	 *  3 SSB lower (phasing)
+	 *  4 SSB upper + lower (phasing)
+	 *  5 NBFM
+	 *  6 raw I&Q with filter
+	 */
+	switch(demod)
+	{
+		case DEMOD_AM:
+			blk_am_det(rc->blk_mag, &rc->am_dc_acc, l, r, n);
+			break;
+
+		case DEMOD_SYNC_AM:
+			blk_sync_det(&rc->pll, rc->blk_i, rc->blk_q, rc->blk_mag,
+				&rc->am_dc_acc, l, r, n, rc->phase_det);
+			break;
+
+		case DEMOD_USB:
+		case DEMOD_LSB:
+		case DEMOD_ULSB:
+			blk_ssb_det(&rc->fb, rc->blk_i, rc->blk_q, l, r, n, demod);
+			break;
+
+		case DEMOD_NBFM:
+			blk_nbfm_det(&rc->nbfm, rc->blk_i, rc->blk_q, l, r, n,
+				rc->phase_det);
+			break;
+
+		case DEMOD_RAW:
+		default:
+			/* raw I & Q with AGC & filter */
+			memcpy(l, rc->blk_i, n*sizeof(float32_t));
+			memcpy(r, rc->blk_q, n*sizeof(float32_t));
+			break;
+	}
+	rx_mark(STAGE_DEMOD, t);
+
+	/* Muting */
+	blk_mute(&rc->mute_state, l, r, n);
+
+	/* Saturate to integer and send to DAC */
+	if(dst)
+		blk_iq_to_s16(dst, l, r, n);
+	rx_mark(STAGE_OUTPUT, t);
+}
+
+/*
+ * one kernel per demod, all for the AUDIO_FILT_BQ section filters
+ */
+#define RX_KERNEL(demod) \
+static void rx_kern_##demod(audio_rx *rc, int16_t *src, \
+	int16_t *dst, float32_t *l, float32_t *r, int n, uint64_t *t) \
+{ \
+	Audio_ProcessBlk(rc, src, dst, l, r, n, t, demod, AUDIO_FILT_BQ); \
+}
+
+RX_KERNEL(DEMOD_AM)
+RX_KERNEL(DEMOD_SYNC_AM)
+RX_KERNEL(DEMOD_USB)
+RX_KERNEL(DEMOD_LSB)
+RX_KERNEL(DEMOD_ULSB)
+RX_KERNEL(DEMOD_NBFM)
+RX_KERNEL(DEMOD_RAW)
+
+static const rx_kernel rx_kernels[DEMOD_MAX] =
+{
+	rx_kern_DEMOD_AM,
+	rx_kern_DEMOD_SYNC_AM,
+	rx_kern_DEMOD_USB,
+	rx_kern_DEMOD_LSB,
+	rx_kern_DEMOD_ULSB,
+	rx_kern_DEMOD_NBFM,
+	rx_kern_DEMOD_RAW,
+};
+
+/*
+ * queue the kernel for the current demod & filter. The audio thread
+ * picks it up at the start of the next buffer.
+ */
+static void Audio_RxSetKernel(audio_rx *r)
+{
+	atomic_store(&r->kernel_req, rx_kernels[r->demod_type]);
+}
+
+/*
+ * run one receiver over a chunk of up to AUDIO_RX_CHUNK frames
+ */
+static void Audio_RxProcess(audio_rx *r, int16_t *src, int16_t *dst, int n,
+	uint64_t *t)
+{
+	int k, m;
+
+	for(k=0;k<n;k+=AUDIO_BLKSZ)
+	{
+		m = n-k > AUDIO_BLKSZ ? AUDIO_BLKSZ : n-k;
+		r->kernel(r, &src[2*k], dst ? &dst[2*k] : NULL,
+			&r->l[k], &r->r[k], m, t);
+	}
+}
+
+/*
+ * run all the active receivers over a chunk & mix to the output
+ */
+static void Audio_ProcessChunk(int16_t *src, int16_t *dst, int n, uint64_t *t)
+{
+	audio_rx *r = rx_active[0];
+	float32_t lvl;
+	int i, k, posted, workers;
+
+	/* a single receiver at unity goes straight out */
+	if(rx_num_active == 1 && r->level == 1.0F)
+	{
+		Audio_RxProcess(r, src, dst, n, t);
+		return;
+	}
+
+	/* hand the rest to the workers */
+	rx_src = src;
+	rx_frames = n;
+	workers = atomic_load_explicit(&rx_num_workers, memory_order_acquire);
+	posted = rx_num_active-1 < workers ? rx_num_active-1 : workers;
+	rx_stride = posted;
+	for(i=0;i<posted;i++)
+		sem_post(&rx_workers[i].go);
+
+	/* the first here, plus the others if there are no workers */
+	Audio_RxProcess(r, src, NULL, n, t);
+	if(!posted)
+		for(i=1;i<rx_num_active;i++)
+			Audio_RxProcess(rx_active[i], src, NULL, n, NULL);
+
+	for(i=0;i<posted;i++)
+		sem_wait(&rx_done);
+
+	/* mix */
+	lvl = r->level;
+	for(k=0;k<n;k++)
+	{
+		mix_l[k] = lvl * r->l[k];
+		mix_r[k] = lvl * r->r[k];
+	}
+	for(i=1;i<rx_num_active;i++)
+	{
+		r = rx_active[i];
+		lvl = r->level;
+		for(k=0;k<n;k++)
 		{
-			/* holding, umuted */
-			mute_gain = 1.0F;
+			mix_l[k] += lvl * r->l[k];
+			mix_r[k] += lvl * r->r[k];
 		}
-		else if((mute_state > 256) && (mute_state<512))
+	}
+
+	/* Saturate to integer and send to DAC */
+	blk_iq_to_s16(dst, mix_l, mix_r, n);
+	stats_mark(STAGE_OUTPUT, t);
+}
+
+/*
+ * process the audio in place
+ */
+void Audio_Process(char *rdbuf, int inframes)
+{
+	Audio_ProcessIO(rdbuf, rdbuf, inframes);
+}
+
+/*
+ * process the audio from inbuf to outbuf
+ */
+void Audio_ProcessIO(char *inbuf, char *outbuf, int inframes)
+{
+	int16_t *src = (int16_t *)inbuf;
+	int16_t *dst = (int16_t *)outbuf;
+	float32_t actual_sr = sample_rate * 12.5F / 12.0F;
+	audio_rx *r;
+	int i, n, frames = inframes;
+	uint64_t t0, t;
+
+	t0 = t = stats_now();
+
+	/* sweep capture & spectrum display */
+	Audio_CaptureTap(src, inframes);
+	Audio_SnapTap(src, inframes);
+
+	/* channelizer replaces the receivers when it's on */
+	if(pfb_process(src, dst, inframes))
+	{
+		stats_mark(STAGE_DEMOD, &t);
+		stats_period(frames, t - t0);
+		return;
+	}
+
+	/* snapshot the receivers for this buffer */
+	rx_num_active = 0;
+	for(i=0;i<AUDIO_MAX_RX;i++)
+	{
+		r = &rx[i];
+		r->enable = atomic_load_explicit(&r->enable_req, memory_order_acquire);
+		if(!r->enable)
+			continue;
+		if(atomic_exchange_explicit(&r->reset_req, 0, memory_order_relaxed))
+			Audio_RxReset(r);
+		rx_active[rx_num_active++] = r;
+
+		/* AGC time constants */
+		if(atomic_exchange_explicit(&r->agc_req, 0, memory_order_acquire))
 		{
-			mute_gain = (float32_t)(511-mute_state)/256.0F;
-			mute_state++;
+			blk_agc_config(&r->agc, r->agc_attack, r->agc_decay, r->agc_hang,
+				actual_sr);
 		}
-		i_mute = i_det * mute_gain;
-		q_mute = q_det * mute_gain;
 
-		/* Saturate to integer and send to DAC */
-		*dst++ = audio_sat(32768*i_mute);
-		*dst++ = audio_sat(32768*q_mute);
+		/* fine tune rate */
+		r->nco_frq = (float32_t)r->offset / actual_sr;
+
+		/* demod changes take effect here, never mid-buffer */
+		r->kernel = atomic_load(&r->kernel_req);
 	}
-	
-	/* update AGC */
-	agc_acc = agc_acc + alpha * (logR - logf(f_pwr));
-	agc_acc = agc_acc > 10.0F ? 10.0F : agc_acc;
-	agc_acc = agc_acc < -10.0F ? -10.0F : agc_acc;
-	agc_gain = expf(agc_acc);
-}
 
+	/* process I2S data in chunks */
+	while(inframes > 0)
+	{
+		n = inframes > AUDIO_RX_CHUNK ? AUDIO_RX_CHUNK : inframes;
+		Audio_ProcessChunk(src, dst, n, &t);
+		src += 2*n;
+		dst += 2*n;
+		inframes -= n;
+	}
+
+	stats_period(frames, t - t0);
+}
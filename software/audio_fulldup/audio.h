@@ -18,6 +18,15 @@ enum demods
 	DEMOD_MAX
 };
 
+/* phase detector used by Sync AM & NBFM */
+enum phase_dets
+{
+	PHASE_LIBM,		/* atan2f() */
+	PHASE_POLY,		/* polynomial atan2 */
+	PHASE_QUAD,		/* NBFM conjugate product, polynomial for Sync AM */
+	PHASE_MAX
+};
+
 enum syncstate
 {
 	SYNC_UNLOCK,
@@ -25,8 +34,22 @@ enum syncstate
 	SYNC_NARROW
 };
 
+/* max receivers on the one I/Q stream */
+#define AUDIO_MAX_RX 8
+
+/* recent I/Q kept for the spectrum display, frames - power of 2 */
+#define AUDIO_SNAP_LEN 8192
+
+/* running input power total - difference two to average over a window */
+typedef struct
+{
+	double sum;
+	uint64_t n;
+} audio_pwr;
+
 extern const char *audio_demod_names[DEMOD_MAX];
 extern const char *audio_sync_names[];
+extern const char *audio_phase_names[PHASE_MAX];
 extern const uint8_t audio_num_filts;
 
 void Audio_Init(void);
@@ -41,6 +64,32 @@ uint16_t Audio_GetMute(void);
 int16_t Audio_GetParam(void);
 int16_t Audio_GetSyncFrq(void);
 int16_t Audio_GetSyncSt(void);
+void Audio_RxEnable(uint8_t n, uint8_t enable);
+uint8_t Audio_RxGetEnable(uint8_t n);
+void Audio_RxSetDemod(uint8_t n, uint8_t demod);
+int8_t Audio_RxGetDemod(uint8_t n);
+void Audio_RxSetFilter(uint8_t n, uint8_t filter);
+uint8_t Audio_RxGetFilter(uint8_t n);
+void Audio_RxSetOffset(uint8_t n, int32_t hz);
+int32_t Audio_RxGetOffset(uint8_t n);
+void Audio_RxSetPhaseDet(uint8_t n, uint8_t phase);
+uint8_t Audio_RxGetPhaseDet(uint8_t n);
+void Audio_RxSetAGC(uint8_t n, float32_t attack_ms, float32_t decay_ms,
+	float32_t hang_ms);
+void Audio_RxGetAGC(uint8_t n, float32_t *attack_ms, float32_t *decay_ms,
+	float32_t *hang_ms);
+void Audio_RxSetLevel(uint8_t n, float32_t level);
+float32_t Audio_RxGetLevel(uint8_t n);
+int16_t Audio_RxGetRSSI(uint8_t n);
+void Audio_RxGetPower(uint8_t n, audio_pwr *p);
+float32_t Audio_PowerDB(const audio_pwr *a, const audio_pwr *b);
+int Audio_RxWorkers(void);
+void Audio_Prefault(void);
+void Audio_CaptureStart(int16_t *buf, int frames);
+int Audio_CaptureWait(int timeout_ms);
+void Audio_SnapEnable(int on);
+int Audio_Snapshot(int16_t *buf, int frames);
 void Audio_Process(char *rdbuf, int inframes);
+void Audio_ProcessIO(char *inbuf, char *outbuf, int inframes);
 
 #endif
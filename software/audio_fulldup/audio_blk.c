@@ -0,0 +1,692 @@
+/*
+ * audio_blk.c - block-oriented DSP passes for the receive chain
+ * 10-16-26 E. Brombaugh
+ *
+ * Each routine makes one pass over a block of samples so that the
+ * stateless stages (format conversion, gain, magnitude, output) can be
+ * vectorized and the recursive stages (DC blocks, allpass sections, PLL)
+ * run as tight loops with their state held in registers. The arithmetic
+ * is done in the same order as the original per-sample loop so results
+ * are bit-exact on x86 and aarch64. On armv7 NEON flushes denormals to
+ * zero, so the output may differ by at most 1 LSB there.
+ */
+
+#include <stdio.h>
+#include <float.h>
+#include <string.h>
+#include "main.h"
+#include "audio.h"
+#include "audio_blk.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLK_NEON
+#endif
+
+#define DC_SCALE (1.0F/1000.0F)
+#define PLL_P_WIDE 1.0e-3F
+#define PLL_I_WIDE 1.0e-6F
+#define PLL_P_NARR 5.0e-6F
+#define PLL_I_NARR 1.0e-8F
+#define PLL_LOCK_THRESH 0.01F
+#define NBFM_DEV_SCL ((19531.25F/2500.0F)/(2.0F*PI))
+#define NBFM_DE_SCALE ((2.0F*PI*300)/19531.25F)
+
+/* AGC gain limit (+/-86dB) */
+#define AGC_MAX_GAIN 22026.0F
+
+/* odd minimax atan on [0,1] */
+#define ATAN_C1 0.99997726F
+#define ATAN_C3 -0.33262347F
+#define ATAN_C5 0.19354346F
+#define ATAN_C7 -0.11643287F
+#define ATAN_C9 0.05265332F
+#define ATAN_C11 -0.01172120F
+
+/* sine LUT */
+float32_t sine_lut[256];
+
+/* SSB Hilbert IIRs */
+const float32_t c_ahi[] =
+{
+	0.5131884F,
+	0.8133175F,
+	0.9359722F,
+	0.9791145F,
+	0.9934793F,
+	0.9989305F
+};
+
+const float32_t c_alo[] =
+{
+	0.2755710F,
+	0.6922636F,
+	0.8896328F,
+	0.9633075F,
+	0.9882633F,
+	0.9965990F
+};
+float32_t ahi[SHIFT_STAGES], alo[SHIFT_STAGES];
+
+/*
+ * init shared tables
+ */
+void blk_init(void)
+{
+	int16_t i;
+
+	/* fill the sine LUT */
+	for(i=0;i<256;i++)
+		sine_lut[i] = sinf(2.0F*PI*(float32_t)i/256.0F);
+
+	/* compute the allpass coeffs */
+	for(i=0;i<SHIFT_STAGES;i++)
+	{
+		ahi[i] = c_ahi[i]*c_ahi[i];
+		alo[i] = c_alo[i]*c_alo[i];
+	}
+}
+
+/*
+ * interpolating LUT-based sine wavetable
+ */
+float32_t sine_wave(float32_t phs)
+{
+    float32_t iphs;
+    phs = modff(phs, &iphs); /* modulo 1.0 */
+	phs *= 256.0F;
+	uint32_t phs_int = (uint32_t)phs;
+	float32_t phs_frac = phs - (float32_t)phs_int;
+	float32_t result = sine_lut[phs_int]*(1.0F-phs_frac);
+	return result + sine_lut[(phs_int+1)&0xFF]*phs_frac;
+}
+
+/*
+ * polynomial atan2 - |error| < 2.0e-6 rad vs. double atan2, 0/0 gives 0.
+ * No branches so the block loop vectorizes.
+ */
+static inline float32_t fast_atan2f(float32_t y, float32_t x)
+{
+	float32_t ax = fabsf(x), ay = fabsf(y), mx, mn, z, z2, a, s;
+
+	/* fold to the first octant */
+	mx = ax > ay ? ax : ay;
+	mn = ax > ay ? ay : ax;
+	z = mn / (mx + FLT_MIN);		/* 0/0 -> 0, no branch */
+	z2 = z*z;
+	a = z*(ATAN_C1 + z2*(ATAN_C3 + z2*(ATAN_C5 + z2*(ATAN_C7 +
+		z2*(ATAN_C9 + z2*ATAN_C11)))));
+
+	/* unfold with 0/1 masks rather than branches */
+	s = (float32_t)(ay > ax);
+	a = s*(0.5F*PI) + (1.0F - 2.0F*s)*a;
+	s = (float32_t)(x < 0.0F);
+	a = s*PI + (1.0F - 2.0F*s)*a;
+	return copysignf(a, y);
+}
+
+/*
+ * block atan2 - out[k] = atan2(y[k], x[k])
+ */
+void blk_atan2(const float32_t *y, const float32_t *x, float32_t *out, int n)
+{
+	int k;
+
+	for(k=0;k<n;k++)
+		out[k] = fast_atan2f(y[k], x[k]);
+}
+
+/*
+ * fine tune - mix I/Q down by a complex LO, phase & freq in cycles
+ */
+void blk_nco(float32_t *i, float32_t *q, float32_t *phs, float32_t frq, int n)
+{
+	float32_t p = *phs, lo_i, lo_q, ti;
+	int k;
+
+	for(k=0;k<n;k++)
+	{
+		lo_i = sine_wave(p+0.25F);
+		lo_q = sine_wave(p);
+
+		/* conjugate mix */
+		ti = i[k];
+		i[k] = ti * lo_i + q[k] * lo_q;
+		q[k] = q[k] * lo_i - ti * lo_q;
+
+		p += frq;
+		if(p >= 1.0F)
+			p -= 1.0F;
+		else if(p < 0.0F)
+			p += 1.0F;
+	}
+	*phs = p;
+}
+
+/*
+ * deinterleave S16 I/Q frames & convert to float
+ */
+void blk_s16_to_iq(const int16_t *src, float32_t *i, float32_t *q, int n)
+{
+	int k = 0;
+
+#ifdef BLK_NEON
+	for(;k<=n-8;k+=8)
+	{
+		int16x8x2_t iq = vld2q_s16(src);
+		src += 16;
+
+		vst1q_f32(i+k, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[0]))), 1.0F/32768.0F));
+		vst1q_f32(i+k+4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[0]))), 1.0F/32768.0F));
+		vst1q_f32(q+k, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[1]))), 1.0F/32768.0F));
+		vst1q_f32(q+k+4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[1]))), 1.0F/32768.0F));
+	}
+#endif
+
+	/* scalar fallback & tail */
+	for(;k<n;k++)
+	{
+		i[k] = (float32_t)*src++/32768.0F;
+		q[k] = (float32_t)*src++/32768.0F;
+	}
+}
+
+/*
+ * scale, saturate & interleave L/R float back to S16 frames
+ */
+void blk_iq_to_s16(int16_t *dst, const float32_t *l, const float32_t *r, int n)
+{
+	int k = 0;
+	float32_t v;
+
+#ifdef BLK_NEON
+	float32x4_t hi = vdupq_n_f32(32767.0F), lo = vdupq_n_f32(-32768.0F);
+	for(;k<=n-4;k+=4)
+	{
+		int16x4x2_t lr;
+		float32x4_t fl = vmulq_n_f32(vld1q_f32(l+k), 32768.0F);
+		float32x4_t fr = vmulq_n_f32(vld1q_f32(r+k), 32768.0F);
+
+		fl = vmaxq_f32(vminq_f32(fl, hi), lo);
+		fr = vmaxq_f32(vminq_f32(fr, hi), lo);
+		lr.val[0] = vmovn_s32(vcvtq_s32_f32(fl));
+		lr.val[1] = vmovn_s32(vcvtq_s32_f32(fr));
+		vst2_s16(dst, lr);
+		dst += 8;
+	}
+#endif
+
+	/* scalar fallback & tail - clamp before convert, same as audio_sat() */
+	for(;k<n;k++)
+	{
+		v = 32768.0F*l[k];
+		v = v > 32767.0F ? 32767.0F : v;
+		v = v < -32768.0F ? -32768.0F : v;
+		*dst++ = (int16_t)v;
+		v = 32768.0F*r[k];
+		v = v > 32767.0F ? 32767.0F : v;
+		v = v < -32768.0F ? -32768.0F : v;
+		*dst++ = (int16_t)v;
+	}
+}
+
+/*
+ * DC blocker - in place. With bypass set the accumulator still tracks
+ * but the input passes through unchanged.
+ */
+void blk_dc_block(float32_t *x, float32_t *acc, int n, uint8_t bypass)
+{
+	float32_t a = *acc, dcb;
+	int k;
+
+	if(bypass)
+	{
+		for(k=0;k<n;k++)
+			a += ((x[k] - a) * DC_SCALE);
+	}
+	else
+	{
+		for(k=0;k<n;k++)
+		{
+			dcb = x[k] - a;
+			a += (dcb * DC_SCALE);
+			x[k] = dcb;
+		}
+	}
+	*acc = a;
+}
+
+/*
+ * AGC reset - unity gain with the envelope at the reference
+ */
+void blk_agc_init(blk_agc_state *agc)
+{
+	agc->env = AGC_REF;
+	agc->hang_cnt = 0;
+	agc->gain = 1.0F;
+	agc->dgain = 0.0F;
+	agc->step = agc->pos = 0;
+	memset(agc->dly_i, 0, sizeof(agc->dly_i));
+	memset(agc->dly_q, 0, sizeof(agc->dly_q));
+}
+
+/*
+ * AGC time constants at a given sample rate. All the transcendentals
+ * are here so the per-sample path is just multiply-adds.
+ */
+void blk_agc_config(blk_agc_state *agc, float32_t attack_ms,
+	float32_t decay_ms, float32_t hang_ms, float32_t rate)
+{
+	float32_t ms = rate / 1000.0F;
+
+	agc->att = attack_ms > 0.0F ? 1.0F - expf(-1.0F/(attack_ms*ms)) : 1.0F;
+	agc->dec = decay_ms > 0.0F ? 1.0F - expf(-1.0F/(decay_ms*ms)) : 1.0F;
+	agc->hang = hang_ms > 0.0F ? (uint32_t)(hang_ms*ms) : 0;
+}
+
+/*
+ * AGC in place, also computing magnitude squared of the output. The
+ * envelope follows the input power - fast attack, hold for the hang time
+ * then decay. Every AGC_STEP samples the gain that puts the envelope at
+ * AGC_REF is computed and the gain ramps there over the next AGC_STEP.
+ * The signal is delayed by AGC_LOOKAHEAD so the gain is already coming
+ * down when a transient reaches the output. All state carries across
+ * calls so the result doesn't depend on the block size.
+ */
+void blk_agc(blk_agc_state *agc, float32_t *i, float32_t *q,
+	float32_t *mag_sq, int n)
+{
+	float32_t env = agc->env, g = agc->gain, dg = agc->dgain, p, t, x;
+	float32_t pwr = 0.0F;
+	uint32_t hc = agc->hang_cnt, step = agc->step, pos = agc->pos;
+	int k;
+
+	for(k=0;k<n;k++)
+	{
+		/* input envelope */
+		p = i[k]*i[k] + q[k]*q[k];
+		pwr += p;
+		if(p > env)
+		{
+			env += agc->att * (p - env);
+			hc = agc->hang;
+		}
+		else if(hc)
+			hc--;
+		else
+			env += agc->dec * (p - env);
+
+		/* next gain target */
+		if(++step == AGC_STEP)
+		{
+			step = 0;
+			t = sqrtf(AGC_REF / (env + FLT_MIN));
+			t = t > AGC_MAX_GAIN ? AGC_MAX_GAIN : t;
+			t = t < (1.0F/AGC_MAX_GAIN) ? (1.0F/AGC_MAX_GAIN) : t;
+			dg = (t - g) * (1.0F/AGC_STEP);
+		}
+		g += dg;
+
+		/* lookahead delay - gain goes out in mag_sq for now */
+		x = agc->dly_i[pos];
+		agc->dly_i[pos] = i[k];
+		i[k] = x;
+		x = agc->dly_q[pos];
+		agc->dly_q[pos] = q[k];
+		q[k] = x;
+		pos = (pos + 1) & (AGC_LOOKAHEAD-1);
+		mag_sq[k] = g;
+	}
+
+	/* gain & magnitude - vectorizes */
+	for(k=0;k<n;k++)
+	{
+		i[k] = i[k] * mag_sq[k];
+		q[k] = q[k] * mag_sq[k];
+		mag_sq[k] = i[k]*i[k] + q[k]*q[k];
+	}
+
+	agc->env = env;
+	agc->gain = g;
+	agc->dgain = dg;
+	agc->hang_cnt = hc;
+	agc->step = step;
+	agc->pos = pos;
+	agc->pwr = pwr;
+}
+
+/*
+ * AM magnitude detector w/ DC block & makeup gain
+ */
+void blk_am_det(const float32_t *mag_sq, float32_t *am_dc_acc,
+	float32_t *l, float32_t *r, int n)
+{
+	float32_t acc = *am_dc_acc, am_dcb;
+	int k;
+
+	/* magnitude - vectorizes */
+	for(k=0;k<n;k++)
+		l[k] = sqrtf(mag_sq[k]);
+
+	/* AM DC Block */
+	for(k=0;k<n;k++)
+	{
+		am_dcb = l[k] - acc;
+		acc += (am_dcb * DC_SCALE);
+		l[k] = 2.0F * am_dcb;
+		r[k] = l[k];
+	}
+	*am_dc_acc = acc;
+}
+
+/*
+ * Sync AM detector - PLL lock depends on the running AM DC estimate so
+ * the DC block is kept in the same loop
+ */
+void blk_sync_det(blk_pll *pll, const float32_t *i, const float32_t *q,
+	const float32_t *mag_sq, float32_t *am_dc_acc, float32_t *l, float32_t *r,
+	int n, uint8_t phase)
+{
+	float32_t pll_i_lo, pll_q_lo, pll_i_bb, pll_q_bb, pll_err;
+	float32_t am_raw, am_dcb;
+	int k;
+
+	for(k=0;k<n;k++)
+	{
+		/* get LO */
+		pll_i_lo = sine_wave(pll->phs+0.25F);
+		pll_q_lo = sine_wave(pll->phs);
+
+		/* conjugate mix down */
+		pll_i_bb = i[k] * pll_i_lo + q[k] * pll_q_lo;
+		pll_q_bb = q[k] * pll_i_lo - i[k] * pll_q_lo;
+
+		/* error is angle or imag of baseband */
+		if(phase == PHASE_LIBM)
+			pll_err = atan2f(pll_q_bb, pll_i_bb);
+		else
+			pll_err = fast_atan2f(pll_q_bb, pll_i_bb);
+
+		/* check for DC estimate ramp up after PLL lock */
+		if((pll->state == 0) && (*am_dc_acc >= PLL_LOCK_THRESH))
+		{
+			/* Start timer */
+			pll->state = 1;
+			pll->count = 5000;
+		}
+
+		/* Reset BW if lost lock */
+		if((pll->state == 2) && (*am_dc_acc < (PLL_LOCK_THRESH/2.0F)))
+			pll->state = 0;
+
+		/* timeout? */
+		if(pll->state == 1)
+		{
+			if(pll->count == 0)
+				pll->state = 2;
+			else
+				pll->count = pll->count - 1;
+		}
+
+		/* loop filter */
+		if(pll->state != 2)
+		{
+			/* Wide bandwidth */
+			pll->frq = pll->intg + PLL_P_WIDE * pll_err;
+			pll->intg += PLL_I_WIDE * pll_err;
+
+			/* output normal demod */
+			am_raw = sqrtf(mag_sq[k]);
+		}
+		else
+		{
+			/* Narrow bandwidth */
+			pll->frq = pll->intg + PLL_P_NARR * pll_err;
+			pll->intg += PLL_I_NARR * pll_err;
+
+			/* output Sync demod */
+			am_raw = pll_i_bb;
+		}
+
+		/* nco */
+		pll->phs += pll->frq;
+		if(pll->phs > 1.0F)
+			pll->phs -=1.0F;
+		else if(pll->phs < 0.0F)
+			pll->phs += 1.0F;
+
+		/* AM DC Block */
+		am_dcb = am_raw - *am_dc_acc;
+		*am_dc_acc += (am_dcb * DC_SCALE);
+
+		/* output with makeup gain */
+		l[k] = 2.0F * am_dcb;
+		r[k] = l[k];
+	}
+}
+
+/*
+ * clear SSB phasing filter state
+ */
+void blk_hilbert_init(blk_hilbert *fb)
+{
+	int16_t i;
+
+	for(i=0;i<SHIFT_STAGES;i++)
+	{
+		fb->state_hi_i[i][0] = 0.0F;
+		fb->state_hi_i[i][1] = 0.0F;
+		fb->state_hi_o[i][0] = 0.0F;
+		fb->state_hi_o[i][1] = 0.0F;
+		fb->state_lo_i[i][0] = 0.0F;
+		fb->state_lo_i[i][1] = 0.0F;
+		fb->state_lo_o[i][0] = 0.0F;
+		fb->state_lo_o[i][1] = 0.0F;
+	}
+	fb->dly = 0.0F;
+
+	/* init DC blocks */
+	fb->lo_dc = fb->hi_dc = 0.0F;
+}
+
+/*
+ * one 2nd-order allpass stage of each chain over a block, in place.
+ * The hi & lo chains are independent so running them together keeps
+ * both recursions in flight.
+ */
+static void blk_allpass2(float32_t ah, float32_t *shi, float32_t *sho,
+	float32_t al, float32_t *sli, float32_t *slo,
+	float32_t *xh, float32_t *xl, int n)
+{
+	float32_t hx1 = shi[0], hx2 = shi[1], hy1 = sho[0], hy2 = sho[1], hy;
+	float32_t lx1 = sli[0], lx2 = sli[1], ly1 = slo[0], ly2 = slo[1], ly;
+	int k;
+
+	for(k=0;k<n;k++)
+	{
+		hy = ah*(xh[k]+hy2)-hx2;
+		hx2 = hx1;
+		hx1 = xh[k];
+		hy2 = hy1;
+		hy1 = hy;
+		xh[k] = hy;
+
+		ly = al*(xl[k]+ly2)-lx2;
+		lx2 = lx1;
+		lx1 = xl[k];
+		ly2 = ly1;
+		ly1 = ly;
+		xl[k] = ly;
+	}
+	shi[0] = hx1;
+	shi[1] = hx2;
+	sho[0] = hy1;
+	sho[1] = hy2;
+	sli[0] = lx1;
+	sli[1] = lx2;
+	slo[0] = ly1;
+	slo[1] = ly2;
+}
+
+/*
+ * SSB phasing detector. The allpass chains are run stage by stage over
+ * the whole block using the output buffers as scratch.
+ */
+void blk_ssb_det(blk_hilbert *fb, const float32_t *i, const float32_t *q,
+	float32_t *l, float32_t *r, int n, uint8_t demod)
+{
+	float32_t ap_i, ap_q, ssb_i, ssb_q, dly;
+	float32_t hi_dc = fb->hi_dc, lo_dc = fb->lo_dc;
+	int k, m;
+
+	/* Hi filters on I, Lo filters on Q */
+	for(k=0;k<n;k++)
+	{
+		l[k] = i[k];
+		r[k] = q[k];
+	}
+	for(m=0;m<SHIFT_STAGES;m++)
+		blk_allpass2(ahi[m], fb->state_hi_i[m], fb->state_hi_o[m],
+			alo[m], fb->state_lo_i[m], fb->state_lo_o[m], l, r, n);
+
+	/* one sample delay on hi side output, DC blocks & sideband select */
+	dly = fb->dly;
+	for(k=0;k<n;k++)
+	{
+		ap_i = dly;
+		dly = l[k];
+		ap_q = r[k];
+
+		/* SSB DC blocks */
+		ssb_i = ap_i - hi_dc;
+		hi_dc += (ssb_i * DC_SCALE);
+		ssb_q = ap_q - lo_dc;
+		lo_dc += (ssb_q * DC_SCALE);
+
+		/* choose sideband for output */
+		if(demod == DEMOD_USB)
+			l[k] = r[k] = ssb_i - ssb_q;	/* upper */
+		else if(demod == DEMOD_LSB)
+			l[k] = r[k] = ssb_i + ssb_q;	/* lower */
+		else
+		{
+			l[k] = ssb_i - ssb_q;	/* upper */
+			r[k] = ssb_i + ssb_q;	/* lower */
+		}
+	}
+	fb->dly = dly;
+	fb->hi_dc = hi_dc;
+	fb->lo_dc = lo_dc;
+}
+
+/*
+ * narrowband FM detector w/ de-emphasis. The phase step comes from one
+ * of
+ *  PHASE_LIBM - atan2f() & differentiate
+ *  PHASE_POLY - blk_atan2() & differentiate
+ *  PHASE_QUAD - conjugate product normalized by the mean power. No atan
+ *   but it reads sin() of the step, ~2% compression at 2.5kHz deviation.
+ * Both the previous phase & the previous sample are kept up to date so
+ * switching modes doesn't click.
+ */
+void blk_nbfm_det(blk_nbfm *fm, const float32_t *i, const float32_t *q,
+	float32_t *l, float32_t *r, int n, uint8_t phase)
+{
+	float32_t pphs = fm->pphs, de_acc = fm->de_acc, nbfm_raw;
+	float32_t pi = fm->pi, pq = fm->pq, pwr;
+	int k;
+
+	if(n <= 0)
+		return;
+
+	if(phase == PHASE_QUAD)
+	{
+		/* phase step, angle taken as atan2(i, q) as below */
+		for(k=0;k<n;k++)
+		{
+			pwr = 0.5F*(i[k]*i[k] + q[k]*q[k] + pi*pi + pq*pq);
+			l[k] = (i[k]*pq - q[k]*pi) / (pwr + FLT_MIN);
+			pi = i[k];
+			pq = q[k];
+		}
+		pphs = atan2f(i[n-1], q[n-1]);
+	}
+	else
+	{
+		/* get phase */
+		if(phase == PHASE_POLY)
+			blk_atan2(i, q, l, n);
+		else
+			for(k=0;k<n;k++)
+				l[k] = atan2f(i[k], q[k]);
+
+		for(k=0;k<n;k++)
+		{
+			/* differentiate */
+			nbfm_raw = l[k] - pphs;
+			pphs = l[k];
+
+			/* unwrap */
+			if(nbfm_raw > PI)
+				nbfm_raw -= 2.0*PI;
+			else if(nbfm_raw < -PI)
+				nbfm_raw += 2.0*PI;
+			l[k] = nbfm_raw;
+		}
+		pi = i[n-1];
+		pq = q[n-1];
+	}
+
+	for(k=0;k<n;k++)
+	{
+		/* deviation adj to 10% full scale */
+		nbfm_raw = l[k] * (NBFM_DEV_SCL/10.0F);
+
+		/* de-emphasis with leak */
+		de_acc = (de_acc*0.99F) + nbfm_raw;
+		l[k] = r[k] = de_acc * NBFM_DE_SCALE;
+	}
+	fm->pphs = pphs;
+	fm->de_acc = de_acc;
+	fm->pi = pi;
+	fm->pq = pq;
+}
+
+/*
+ * mute ramp - 0-255 ramping up, 256 unmuted, 257-511 ramping down,
+ * 512 muted
+ */
+void blk_mute(uint16_t *mute_state, float32_t *l, float32_t *r, int n)
+{
+	uint16_t ms = *mute_state;
+	float32_t mute_gain;
+	int k;
+
+	/* holding, unmuted */
+	if(ms == 256)
+		return;
+
+	for(k=0;k<n;k++)
+	{
+		mute_gain = 0.0F;
+		if(ms<256)
+		{
+			/* ramping up */
+			mute_gain = (float32_t)ms/256.0F;
+			ms++;
+		}
+		else if(ms == 256)
+		{
+			/* holding, umuted */
+			mute_gain = 1.0F;
+		}
+		else if((ms > 256) && (ms<512))
+		{
+			mute_gain = (float32_t)(511-ms)/256.0F;
+			ms++;
+		}
+		l[k] = l[k] * mute_gain;
+		r[k] = r[k] * mute_gain;
+	}
+	*mute_state = ms;
+}
@@ -0,0 +1,94 @@
+/*
+ * audio_blk.h - block-oriented DSP passes for the receive chain
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __audio_blk__
+#define __audio_blk__
+
+#include "main.h"
+
+/* max frames handled by one pass - Audio_Process() splits longer buffers */
+#define AUDIO_BLKSZ 256
+
+/* alignment for block scratch buffers */
+#define BLK_ALIGN __attribute__ ((aligned (16)))
+
+/* AGC lookahead delay in samples - power of 2 */
+#define AGC_LOOKAHEAD 64
+
+/* AGC output power */
+#define AGC_REF 0.01F
+
+/* AGC gain is recomputed every AGC_STEP samples & ramped in between */
+#define AGC_STEP 16
+
+/* SSB Hilbert allpass stages */
+#define SHIFT_STAGES 6
+
+/* sync AM PLL state */
+typedef struct
+{
+	float32_t intg, frq, phs;
+	uint16_t count;
+	uint8_t state;
+} blk_pll;
+
+/* AGC state */
+typedef struct
+{
+	float32_t att, dec;			/* envelope coeffs per sample */
+	uint32_t hang;				/* envelope hold, samples */
+	float32_t env;				/* input power envelope */
+	uint32_t hang_cnt;
+	float32_t gain, dgain;		/* current gain & per sample ramp */
+	uint32_t step, pos;
+	float32_t pwr;				/* input power summed over the last call */
+	float32_t dly_i[AGC_LOOKAHEAD], dly_q[AGC_LOOKAHEAD];
+} blk_agc_state;
+
+/* SSB phasing filter state */
+typedef struct
+{
+	/* Allpass state */
+	float32_t state_hi_i[SHIFT_STAGES][2];
+	float32_t state_hi_o[SHIFT_STAGES][2], dly;
+	float32_t state_lo_i[SHIFT_STAGES][2];
+	float32_t state_lo_o[SHIFT_STAGES][2];
+
+	/* DC block state */
+	float32_t lo_dc, hi_dc;
+} blk_hilbert;
+
+/* narrowband FM state */
+typedef struct
+{
+	float32_t pphs, de_acc;
+	float32_t pi, pq;			/* previous sample */
+} blk_nbfm;
+
+void blk_init(void);
+float32_t sine_wave(float32_t phs);
+void blk_s16_to_iq(const int16_t *src, float32_t *i, float32_t *q, int n);
+void blk_iq_to_s16(int16_t *dst, const float32_t *l, const float32_t *r, int n);
+void blk_nco(float32_t *i, float32_t *q, float32_t *phs, float32_t frq, int n);
+void blk_atan2(const float32_t *y, const float32_t *x, float32_t *out, int n);
+void blk_dc_block(float32_t *x, float32_t *acc, int n, uint8_t bypass);
+void blk_agc_init(blk_agc_state *agc);
+void blk_agc_config(blk_agc_state *agc, float32_t attack_ms,
+	float32_t decay_ms, float32_t hang_ms, float32_t rate);
+void blk_agc(blk_agc_state *agc, float32_t *i, float32_t *q,
+	float32_t *mag_sq, int n);
+void blk_am_det(const float32_t *mag_sq, float32_t *am_dc_acc,
+	float32_t *l, float32_t *r, int n);
+void blk_sync_det(blk_pll *pll, const float32_t *i, const float32_t *q,
+	const float32_t *mag_sq, float32_t *am_dc_acc, float32_t *l, float32_t *r,
+	int n, uint8_t phase);
+void blk_hilbert_init(blk_hilbert *fb);
+void blk_ssb_det(blk_hilbert *fb, const float32_t *i, const float32_t *q,
+	float32_t *l, float32_t *r, int n, uint8_t demod);
+void blk_nbfm_det(blk_nbfm *fm, const float32_t *i, const float32_t *q,
+	float32_t *l, float32_t *r, int n, uint8_t phase);
+void blk_mute(uint16_t *mute_state, float32_t *l, float32_t *r, int n);
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * backend.h - audio I/O backend interface
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __backend__
+#define __backend__
+
+typedef struct
+{
+	const char *name;
+	int (*open)(void);							/* 0 = OK */
+	long (*read)(char *buf, unsigned long frames);	/* 0 = end, < 0 = error */
+	long (*write)(char *buf, unsigned long frames);
+	void (*close)(void);
+} audio_backend;
+
+#endif
@@ -0,0 +1,539 @@
+/*
+ * bench.c - microbenchmarks for the DSP primitives
+ * 10-16-26 E. Brombaugh
+ *
+ * Times each routine over synthetic buffers and prints one tab separated
+ * line per routine so results can be diffed across commits:
+ *
+ *   name  samples  reps  best_ns  mean_ns  msps
+ *
+ * best_ns & mean_ns are ns per sample, msps is Msamples/s at best_ns.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "main.h"
+#include "audio.h"
+#include "audio_lib.h"
+#include "audio_blk.h"
+#include "iir.h"
+#include "pfb.h"
+#include "r820t2.h"
+
+/* needed by audio.c */
+int sample_rate = 48000;
+
+/* bench length in frames - audio_lib sizes are int16_t */
+#define BENCH_LEN 16384
+
+/* tuner retunes - a 12.5kHz channel plan that fits the plan cache and
+   a 4x longer one that misses every time */
+#define BENCH_CH R820T2_PLAN_CACHE
+#define BENCH_CH_MISS (4*R820T2_PLAN_CACHE)
+#define BENCH_CH_BASE 144000000
+#define BENCH_CH_STEP 12500
+
+/* buffer size handed to Audio_Process() */
+int bench_period = 1024;
+
+/* repetitions & warmup passes */
+int bench_reps = 50;
+int bench_warmup = 5;
+
+/* synthetic data */
+int16_t src_iq[2*BENCH_LEN] BLK_ALIGN, buf_iq[2*BENCH_LEN] BLK_ALIGN;
+int16_t s16_a[BENCH_LEN] BLK_ALIGN, s16_b[BENCH_LEN] BLK_ALIGN;
+int16_t s16_c[BENCH_LEN] BLK_ALIGN, s16_d[BENCH_LEN] BLK_ALIGN;
+float32_t f_i[BENCH_LEN] BLK_ALIGN, f_q[BENCH_LEN] BLK_ALIGN;
+float32_t f_l[BENCH_LEN] BLK_ALIGN, f_r[BENCH_LEN] BLK_ALIGN;
+float32_t f_mag[BENCH_LEN] BLK_ALIGN;
+
+/* IIR rows filter these in place, over & over - keeps copies out of the
+   timed kernels and the tone keeps them well clear of denormals */
+float32_t f_iir_i[BENCH_LEN] BLK_ALIGN, f_iir_q[BENCH_LEN] BLK_ALIGN;
+
+/* keeps results live */
+volatile float32_t sink;
+volatile int32_t isink;
+
+/* 8kHz lowpass from iir_coeffs.h */
+const bq_coeffs bench_bq[3] =
+{
+	{{ 1.0000,  2.0000,  1.0000}, { 1.0000, -0.8795,  0.6413},  0.1905},
+	{{ 1.0000,  2.0000,  1.0000}, { 1.0000, -0.6710,  0.2523},  0.1453},
+	{{ 1.0000,  2.0000,  1.0000}, { 1.0000, -0.5903,  0.1016},  0.1278},
+};
+bq_state bench_i_s[3], bench_q_s[3];
+iir bench_i_iir, bench_q_iir;
+
+/* DSP block state */
+blk_hilbert bench_fb;
+blk_pll bench_pll;
+blk_nbfm bench_nbfm;
+blk_agc_state bench_agc;
+float32_t bench_dc_acc;
+uint16_t bench_mute;
+uint8_t bench_demod, bench_phase;
+
+/*
+ * fill buffers with a tone plus noise at roughly -12dBFS
+ */
+void bench_fill(void)
+{
+	float32_t ph = 0.0F;
+	int k;
+
+	srand(1);
+	for(k=0;k<BENCH_LEN;k++)
+	{
+		src_iq[2*k] = 8000.0F*cosf(ph) + (rand()&0x3ff) - 0x200;
+		src_iq[2*k+1] = 8000.0F*sinf(ph) + (rand()&0x3ff) - 0x200;
+		ph += 0.0613F;
+		if(ph > PI)
+			ph -= 2.0F*PI;
+
+		s16_a[k] = src_iq[2*k];
+		s16_b[k] = src_iq[2*k+1];
+		f_i[k] = (float32_t)src_iq[2*k] / 32768.0F;
+		f_q[k] = (float32_t)src_iq[2*k+1] / 32768.0F;
+	}
+	memcpy(f_iir_i, f_i, sizeof(f_iir_i));
+	memcpy(f_iir_q, f_q, sizeof(f_iir_q));
+}
+
+/*
+ * ns elapsed between two timestamps
+ */
+double bench_ns(struct timespec *a, struct timespec *b)
+{
+	return (double)(b->tv_sec - a->tv_sec)*1e9 + (double)(b->tv_nsec - a->tv_nsec);
+}
+
+/*
+ * time one routine and print a table row
+ */
+void bench_run(const char *name, void (*fn)(void), int samples)
+{
+	struct timespec a, b;
+	double ns, best = 1e30, total = 0.0;
+	int r;
+
+	for(r=0;r<bench_warmup;r++)
+		fn();
+
+	for(r=0;r<bench_reps;r++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		fn();
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		ns = bench_ns(&a, &b) / samples;
+		total += ns;
+		if(ns < best)
+			best = ns;
+	}
+
+	printf("%s\t%d\t%d\t%.3f\t%.3f\t%.2f\n", name, samples, bench_reps,
+		best, total / bench_reps, 1e3 / best);
+}
+
+/*
+ * scalar IIR, one call per sample per channel - same work as the block
+ * kernel below so the two rows compare per I/Q frame
+ */
+void b_iir_calc(void)
+{
+	int k;
+
+	for(k=0;k<BENCH_LEN;k++)
+	{
+		f_iir_i[k] = iir_calc(&bench_i_iir, f_iir_i[k]);
+		f_iir_q[k] = iir_calc(&bench_q_iir, f_iir_q[k]);
+	}
+	sink = f_iir_i[BENCH_LEN-1];
+}
+
+/*
+ * I/Q IIR block kernel
+ */
+void b_iir_block_iq(void)
+{
+	iir_calc_block_iq(&bench_i_iir, &bench_q_iir, f_iir_i, f_iir_q, BENCH_LEN, 1);
+	sink = f_iir_i[BENCH_LEN-1];
+}
+
+/*
+ * sine LUT w/ interpolation
+ */
+void b_sine_wave(void)
+{
+	float32_t acc = 0.0F, phs = 0.0F;
+	int k;
+
+	for(k=0;k<BENCH_LEN;k++)
+	{
+		acc += sine_wave(phs);
+		phs += 0.0613F;
+		if(phs >= 1.0F)
+			phs -= 1.0F;
+	}
+	sink = acc;
+}
+
+/*
+ * S16 <-> float conversion
+ */
+void b_s16_to_iq(void)
+{
+	blk_s16_to_iq(src_iq, f_l, f_r, BENCH_LEN);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_iq_to_s16(void)
+{
+	blk_iq_to_s16(buf_iq, f_i, f_q, BENCH_LEN);
+	isink = buf_iq[BENCH_LEN-1];
+}
+
+/*
+ * DC blocker
+ */
+void b_dc_block(void)
+{
+	memcpy(f_l, f_i, sizeof(f_l));
+	blk_dc_block(f_l, &bench_dc_acc, BENCH_LEN, 0);
+	sink = f_l[BENCH_LEN-1];
+}
+
+/*
+ * AGC envelope, lookahead & gain ramp plus magnitude
+ */
+void b_agc(void)
+{
+	memcpy(f_l, f_i, sizeof(f_l));
+	memcpy(f_r, f_q, sizeof(f_r));
+	blk_agc(&bench_agc, f_l, f_r, f_mag, BENCH_LEN);
+	sink = bench_agc.gain;
+}
+
+/*
+ * Hilbert allpass chains & sideband select
+ */
+void b_hilbert(void)
+{
+	blk_ssb_det(&bench_fb, f_i, f_q, f_l, f_r, BENCH_LEN, DEMOD_ULSB);
+	sink = f_l[BENCH_LEN-1];
+}
+
+/*
+ * individual detectors
+ */
+void b_am_det(void)
+{
+	int k;
+
+	for(k=0;k<BENCH_LEN;k++)
+		f_mag[k] = f_i[k]*f_i[k] + f_q[k]*f_q[k];
+	blk_am_det(f_mag, &bench_dc_acc, f_l, f_r, BENCH_LEN);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_sync_det(void)
+{
+	blk_sync_det(&bench_pll, f_i, f_q, f_mag, &bench_dc_acc, f_l, f_r,
+		BENCH_LEN, bench_phase);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_nbfm_det(void)
+{
+	blk_nbfm_det(&bench_nbfm, f_i, f_q, f_l, f_r, BENCH_LEN, bench_phase);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_atan2f(void)
+{
+	int k;
+
+	for(k=0;k<BENCH_LEN;k++)
+		f_l[k] = atan2f(f_i[k], f_q[k]);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_atan2(void)
+{
+	blk_atan2(f_i, f_q, f_l, BENCH_LEN);
+	sink = f_l[BENCH_LEN-1];
+}
+
+void b_mute(void)
+{
+	memcpy(f_l, f_i, sizeof(f_l));
+	memcpy(f_r, f_q, sizeof(f_r));
+	blk_mute(&bench_mute, f_l, f_r, BENCH_LEN);
+	sink = f_l[BENCH_LEN-1];
+}
+
+/*
+ * whole chain for the current demod
+ */
+void b_audio_process(void)
+{
+	int k;
+
+	memcpy(buf_iq, src_iq, sizeof(buf_iq));
+	for(k=0;k<BENCH_LEN;k+=bench_period)
+		Audio_Process((char *)&buf_iq[2*k], bench_period);
+	isink = buf_iq[0];
+}
+
+/*
+ * audio_lib routines
+ */
+void b_audio_sat(void)
+{
+	int32_t acc = 0;
+	int k;
+
+	for(k=0;k<BENCH_LEN;k++)
+		acc += audio_sat(((int32_t)s16_a[k])<<2);
+	isink = acc;
+}
+
+void b_audio_split_stereo(void)
+{
+	audio_split_stereo(BENCH_LEN, src_iq, s16_c, s16_d);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_clip(void)
+{
+	isink = audio_clip(BENCH_LEN, s16_a, 32000);
+}
+
+void b_audio_sum_stereo(void)
+{
+	memcpy(s16_c, s16_a, sizeof(s16_c));
+	audio_sum_stereo(BENCH_LEN, s16_c, s16_b);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_copy(void)
+{
+	audio_copy(BENCH_LEN, s16_c, s16_a);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_sop3(void)
+{
+	audio_sop3(BENCH_LEN, s16_c, s16_a, s16_b, 0.1F, 0.5F, 0.25F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_sop2(void)
+{
+	audio_sop2(BENCH_LEN, s16_c, s16_a, 0.5F, 0.25F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_gain(void)
+{
+	audio_gain(BENCH_LEN, s16_c, s16_a, 0.7F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_gain_sum(void)
+{
+	memcpy(s16_c, s16_b, sizeof(s16_c));
+	audio_gain_sum(BENCH_LEN, s16_c, s16_a, 0.7F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_comb_stereo(void)
+{
+	audio_comb_stereo(BENCH_LEN, buf_iq, s16_a, s16_b);
+	isink = buf_iq[BENCH_LEN-1];
+}
+
+void b_audio_morph(void)
+{
+	audio_morph(BENCH_LEN, s16_c, s16_a, s16_b, 0.3F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+void b_audio_cp2mix(void)
+{
+	audio_cp2mix(BENCH_LEN, s16_c, s16_a, s16_b, 0.3F);
+	isink = s16_c[BENCH_LEN-1];
+}
+
+/*
+ * R820T2 retune CPU time - plan from scratch vs the plan cache
+ */
+void b_r820t2_plan(void)
+{
+	r820t_plan p;
+	int32_t acc = 0;
+	int k;
+
+	for(k=0;k<BENCH_CH;k++)
+	{
+		R820T2_plan_freq(BENCH_CH_BASE + k*BENCH_CH_STEP, &p);
+		acc += p.n;
+	}
+	isink = acc;
+}
+
+void b_r820t2_plan_hit(void)
+{
+	int32_t acc = 0;
+	int k;
+
+	for(k=0;k<BENCH_CH;k++)
+		acc += R820T2_plan_get(BENCH_CH_BASE + k*BENCH_CH_STEP)->n;
+	isink = acc;
+}
+
+void b_r820t2_plan_miss(void)
+{
+	int32_t acc = 0;
+	int k;
+
+	for(k=0;k<BENCH_CH_MISS;k++)
+		acc += R820T2_plan_get(BENCH_CH_BASE + k*BENCH_CH_STEP)->n;
+	isink = acc;
+}
+
+/*
+ * usage
+ */
+void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options]\n", name);
+	fprintf(stderr, "  -b <frames>  Audio_Process() buffer size (%d)\n", bench_period);
+	fprintf(stderr, "  -f <filter>  IF filter index for demod runs (2)\n");
+	fprintf(stderr, "  -n <reps>    timed repetitions (%d)\n", bench_reps);
+	fprintf(stderr, "  -w <reps>    warmup repetitions (%d)\n", bench_warmup);
+	fprintf(stderr, "  -h           this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	char name[32];
+	int opt, filter = 2;
+	uint8_t d;
+
+	while((opt = getopt(argc, argv, "b:f:n:w:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				bench_period = atoi(optarg);
+				break;
+			case 'f':
+				filter = atoi(optarg);
+				break;
+			case 'n':
+				bench_reps = atoi(optarg);
+				break;
+			case 'w':
+				bench_warmup = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+
+	/* period must divide the bench length */
+	if((bench_period < 1) || (bench_period > BENCH_LEN) ||
+		(BENCH_LEN % bench_period))
+	{
+		fprintf(stderr, "buffer size must divide %d\n", BENCH_LEN);
+		exit(1);
+	}
+	if(bench_reps < 1)
+		bench_reps = 1;
+
+	/* setup */
+	bench_fill();
+	blk_init();
+	blk_hilbert_init(&bench_fb);
+	iir_init(&bench_i_iir, bench_i_s, (bq_coeffs *)bench_bq, 3);
+	iir_init(&bench_q_iir, bench_q_s, (bq_coeffs *)bench_bq, 3);
+	blk_agc_init(&bench_agc);
+	blk_agc_config(&bench_agc, 2.0F, 500.0F, 250.0F, 50000.0F);
+
+	printf("# name\tsamples\treps\tbest_ns\tmean_ns\tmsps\n");
+
+	/* primitives */
+	bench_run("iir_calc", b_iir_calc, BENCH_LEN);
+	bench_run("iir_calc_block_iq", b_iir_block_iq, BENCH_LEN);
+	bench_run("sine_wave", b_sine_wave, BENCH_LEN);
+	bench_run("blk_s16_to_iq", b_s16_to_iq, BENCH_LEN);
+	bench_run("blk_iq_to_s16", b_iq_to_s16, BENCH_LEN);
+	bench_run("blk_dc_block", b_dc_block, BENCH_LEN);
+	bench_run("agc", b_agc, BENCH_LEN);
+	bench_run("hilbert", b_hilbert, BENCH_LEN);
+	bench_run("blk_am_det", b_am_det, BENCH_LEN);
+	bench_run("atan2f", b_atan2f, BENCH_LEN);
+	bench_run("blk_atan2", b_atan2, BENCH_LEN);
+	for(bench_phase=0;bench_phase<PHASE_MAX;bench_phase++)
+	{
+		snprintf(name, sizeof(name), "blk_sync_det_%s",
+			audio_phase_names[bench_phase]);
+		bench_run(name, b_sync_det, BENCH_LEN);
+		snprintf(name, sizeof(name), "blk_nbfm_det_%s",
+			audio_phase_names[bench_phase]);
+		bench_run(name, b_nbfm_det, BENCH_LEN);
+	}
+	bench_run("blk_mute", b_mute, BENCH_LEN);
+
+	/* full chain per demod */
+	for(d=0;d<DEMOD_MAX;d++)
+	{
+		Audio_Init();
+		Audio_SetFilter(filter);
+		Audio_SetDemod(d);
+		snprintf(name, sizeof(name), "Audio_Process_%s", audio_demod_names[d]);
+		bench_run(name, b_audio_process, BENCH_LEN);
+	}
+
+	/* channelizer in place of the receivers */
+	for(d=8;d<=32;d*=2)
+	{
+		Audio_Init();
+		pfb_set_channels(d);
+		snprintf(name, sizeof(name), "pfb_%d", d);
+		bench_run(name, b_audio_process, BENCH_LEN);
+	}
+	pfb_set_channels(0);
+
+	/* audio_lib */
+	bench_run("audio_sat", b_audio_sat, BENCH_LEN);
+	bench_run("audio_split_stereo", b_audio_split_stereo, BENCH_LEN);
+	bench_run("audio_clip", b_audio_clip, BENCH_LEN);
+	bench_run("audio_sum_stereo", b_audio_sum_stereo, BENCH_LEN);
+	bench_run("audio_copy", b_audio_copy, BENCH_LEN);
+	bench_run("audio_sop3", b_audio_sop3, BENCH_LEN);
+	bench_run("audio_sop2", b_audio_sop2, BENCH_LEN);
+	bench_run("audio_gain", b_audio_gain, BENCH_LEN);
+	bench_run("audio_gain_sum", b_audio_gain_sum, BENCH_LEN);
+	bench_run("audio_comb_stereo", b_audio_comb_stereo, BENCH_LEN);
+	bench_run("audio_morph", b_audio_morph, BENCH_LEN);
+	bench_run("audio_cp2mix", b_audio_cp2mix, BENCH_LEN);
+
+	/* tuner plans - ns per retune */
+	r820t_xtal_freq = 28800000;
+	r820t_if_freq = 5000000;
+	bench_run("r820t2_plan", b_r820t2_plan, BENCH_CH);
+	R820T2_plan_prefill(BENCH_CH_BASE, BENCH_CH_BASE + (BENCH_CH-1)*BENCH_CH_STEP,
+		BENCH_CH_STEP);
+	bench_run("r820t2_plan_hit", b_r820t2_plan_hit, BENCH_CH);
+	bench_run("r820t2_plan_miss", b_r820t2_plan_miss, BENCH_CH_MISS);
+
+	return 0;
+}
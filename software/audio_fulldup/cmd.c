@@ -14,9 +14,22 @@
 #include "audio.h"
 #include "rxadc.h"
 #include "r820t2.h"
+#include "stats.h"
+#include "pfb.h"
+#include "hwq.h"
+#include "scan.h"
+#include "sweep.h"
+#include "spec.h"
 
 #define MAX_ARGS 4
 
+/* tune screen spectrum - bars from -100 to -20 dBFS, waterfall below */
+#define TUNE_SPEC_ROW 18
+#define TUNE_SPEC_ROWS 8
+#define TUNE_SPEC_TOP_DB -20.0F
+#define TUNE_SPEC_DB_ROW 10.0F
+#define TUNE_WF_MIN 2
+
 /* locals we use here */
 char cmd_buffer[256];
 char *cmd_wptr;
@@ -40,6 +53,17 @@ const char *cmd_commands[] =
     "r820t2_mixer_agc_ena",
     "r820t2_bandwidth",
     "vhf_freq",
+    "r820t2_plans",
+	"pipeline",
+	"stats",
+	"rx",
+	"pfb",
+	"agc",
+	"poll",
+	"hwq",
+	"scan",
+	"sweep",
+	"spec",
 	"quit",
 	""
 };
@@ -64,10 +88,29 @@ enum cmd_indices
     CMD_R820_MIXER_AGC_ENA,
     CMD_R820_BANDWIDTH,
     CMD_VHF_FREQ,
+    CMD_R820_PLANS,
+	CMD_PIPELINE,
+	CMD_STATS,
+	CMD_RX,
+	CMD_PFB,
+	CMD_AGC,
+	CMD_POLL,
+	CMD_HWQ,
+	CMD_SCAN,
+	CMD_SWEEP,
+	CMD_SPEC,
 	CMD_QUIT,
 	CMD_MAX
 };
 
+/* tune screen spectrum panel */
+int tune_spec_on = 1;
+WINDOW *tune_wf;
+int tune_cols, tune_bar[SPEC_MAX_COLS];
+float32_t tune_db[SPEC_MAX_COLS];
+int32_t tune_axis_lo;
+const char tune_wf_ramp[] = " .:-=+*#%@";
+
 /* reset buffer & display the prompt */
 void cmd_prompt(void)
 {
@@ -78,6 +121,267 @@ void cmd_prompt(void)
 	printf("\rCommand>");
 }
 
+/* redraw the prompt & whatever has been typed so far */
+static void cmd_reprompt(void)
+{
+	printf("\rCommand>%.*s", (int)(cmd_wptr - &cmd_buffer[0]), cmd_buffer);
+	fflush(stdout);
+}
+
+/*
+ * hardware commands - these run on the hwq worker so a slow tuner
+ * operation doesn't stall the prompt or the tune screen
+ */
+static void hw_spi_read(hwq_cmd *c)
+{
+	ice_read(bs, c->arg[0], &c->arg[1]);
+}
+
+static void hw_spi_write(hwq_cmd *c)
+{
+	ice_write(bs, c->arg[0], c->arg[1]);
+	rxadc_invalidate();
+}
+
+static void hw_lo_read(hwq_cmd *c)
+{
+	c->arg[0] = rxadc_get_lo();
+}
+
+static void hw_lo_write(hwq_cmd *c)
+{
+	c->arg[0] = rxadc_set_lo(c->arg[0]);
+}
+
+static void hw_ifgain(hwq_cmd *c)
+{
+	rxadc_set_ifgain(c->arg[0]);
+}
+
+static void hw_r820_read(hwq_cmd *c)
+{
+	c->arg[1] = R820T2_i2c_read_reg_uncached(c->arg[0]);
+}
+
+static void hw_r820_write(hwq_cmd *c)
+{
+	R820T2_i2c_write_reg(c->arg[0], c->arg[1]);
+}
+
+static void hw_r820_freq(hwq_cmd *c)
+{
+	R820T2_set_freq(c->arg[0]);
+}
+
+static void hw_r820_lna_gain(hwq_cmd *c)
+{
+	R820T2_set_lna_gain(c->arg[0]);
+}
+
+static void hw_r820_mixer_gain(hwq_cmd *c)
+{
+	R820T2_set_mixer_gain(c->arg[0]);
+}
+
+static void hw_r820_vga_gain(hwq_cmd *c)
+{
+	R820T2_set_vga_gain(c->arg[0]);
+}
+
+static void hw_r820_lna_agc(hwq_cmd *c)
+{
+	R820T2_set_lna_agc(c->arg[0]);
+}
+
+static void hw_r820_mixer_agc(hwq_cmd *c)
+{
+	R820T2_set_mixer_agc(c->arg[0]);
+}
+
+static void hw_r820_bandwidth(hwq_cmd *c)
+{
+	R820T2_set_if_bandwidth(c->arg[0]);
+}
+
+static void hw_vhf_freq(hwq_cmd *c)
+{
+	const r820t_plan *p = R820T2_plan_get(c->arg[0]);
+
+	/* set VHF freq, then HF Freq to where it lands in the IF */
+	R820T2_set_plan(p);
+	c->arg[1] = rxadc_set_lo(R820T2_plan_if(p, c->arg[0]));
+	c->arg[0] = p->freq;
+}
+
+static void hw_r820_plan_fill(hwq_cmd *c)
+{
+	c->arg[1] = R820T2_plan_prefill(c->arg[0], c->arg[1], r820t_plan_step);
+}
+
+static void hw_r820_plan_clear(hwq_cmd *c)
+{
+	if(!c->arg[0])
+		c->arg[0] = 1;
+	r820t_plan_step = c->arg[0];
+	R820T2_plan_clear();
+}
+
+/* completion - print the result without losing the line being typed */
+static void cmd_report(hwq_cmd *c)
+{
+	printf("\r");
+	printf(c->fmt, c->arg[0], c->arg[1]);
+	cmd_reprompt();
+}
+
+
+/* queue a hardware command, fmt reports arg[0] & arg[1] when it's done */
+static hwq_cmd *cmd_hw(void (*run)(hwq_cmd *), const char *fmt,
+	uint32_t arg0, uint32_t arg1)
+{
+	hwq_cmd *c;
+	
+	if(scan_active() || sweep_active())
+	{
+		printf("\r%s - %s stop first\n", scan_active() ? "scanning" : "sweeping",
+			scan_active() ? "scan" : "sweep");
+		return NULL;
+	}
+	if((c = hwq_alloc()) == NULL)
+	{
+		printf("hardware queue full\n");
+		return NULL;
+	}
+	c->run = run;
+	c->done = fmt ? cmd_report : NULL;
+	c->fmt = fmt;
+	c->arg[0] = arg0;
+	c->arg[1] = arg1;
+	hwq_submit(c);
+	return c;
+}
+
+/* tune screen LO change finished */
+static void tune_lo_done(hwq_cmd *c)
+{
+	*(int *)c->ctx = 0;
+}
+
+/* retune in the background, newest setting once the last one is done */
+static void tune_lo(int32_t lo_freq, int32_t *lo_sent, int *lo_busy)
+{
+	hwq_cmd *c;
+	
+	hwq_reap();
+	if(lo_freq != *lo_sent && !*lo_busy &&
+		(c = cmd_hw(hw_lo_write, NULL, lo_freq, 0)) != NULL)
+	{
+		c->done = tune_lo_done;
+		c->ctx = lo_busy;
+		*lo_busy = 1;
+		*lo_sent = lo_freq;
+	}
+}
+
+/* scan stopped - say where */
+static void cmd_scan_done(void)
+{
+	printf("\rscan: stopped on %u Hz\n", scan_freq());
+	cmd_reprompt();
+}
+
+/* sweep finished */
+static void cmd_sweep_done(int err)
+{
+	(void)err;
+	printf("\r");
+	sweep_report(stdout);
+	cmd_reprompt();
+}
+
+/* spectrum panel under the tune screen text - 0 if it won't fit */
+static int tune_spec_open(void)
+{
+	int wf_rows = LINES - (TUNE_SPEC_ROW + TUNE_SPEC_ROWS + 1);
+	
+	if(wf_rows < TUNE_WF_MIN)
+		return 0;
+	tune_cols = COLS > SPEC_MAX_COLS ? SPEC_MAX_COLS : COLS;
+	if(spec_start(tune_cols))
+		return 0;
+	
+	/* scrolling region so the terminal shifts the waterfall, not us */
+	tune_wf = newwin(wf_rows, tune_cols, TUNE_SPEC_ROW + TUNE_SPEC_ROWS + 1, 0);
+	scrollok(tune_wf, TRUE);
+	idlok(tune_wf, TRUE);
+	leaveok(tune_wf, TRUE);
+	memset(tune_bar, 0, sizeof(tune_bar));
+	tune_axis_lo = -1;
+	return 1;
+}
+
+static void tune_spec_close(void)
+{
+	spec_stop();
+	if(tune_wf)
+	{
+		delwin(tune_wf);
+		tune_wf = NULL;
+	}
+	move(TUNE_SPEC_ROW, 0);
+	clrtobot();
+}
+
+/* frequency scale under the bars - only when the LO moves */
+static void tune_spec_axis(int32_t lo_freq)
+{
+	float32_t span = sample_rate * 12.5F / 12.0F;
+	char textbuf[32];
+	int row = TUNE_SPEC_ROW + TUNE_SPEC_ROWS;
+	
+	if(lo_freq == tune_axis_lo)
+		return;
+	tune_axis_lo = lo_freq;
+	move(row, 0);
+	clrtoeol();
+	sprintf(textbuf, "%.1fk", (lo_freq - span/2.0F) / 1000.0F);
+	mvaddstr(row, 0, textbuf);
+	sprintf(textbuf, "^%.1fk", lo_freq / 1000.0F);
+	mvaddstr(row, tune_cols/2, textbuf);
+	sprintf(textbuf, "%.1fk", (lo_freq + span/2.0F) / 1000.0F);
+	mvaddstr(row, tune_cols - strlen(textbuf), textbuf);
+}
+
+/* new spectrum - bars only touch cells whose height changed */
+static void tune_spec_draw(void)
+{
+	float32_t floor_db = TUNE_SPEC_TOP_DB - TUNE_SPEC_ROWS*TUNE_SPEC_DB_ROW;
+	int c, h, r, nr = sizeof(tune_wf_ramp) - 2;
+	
+	if(!spec_get(tune_db))
+		return;
+	
+	for(c=0;c<tune_cols;c++)
+	{
+		h = (tune_db[c] - floor_db) / TUNE_SPEC_DB_ROW + 0.5F;
+		h = h < 0 ? 0 : h > TUNE_SPEC_ROWS ? TUNE_SPEC_ROWS : h;
+		for(r=tune_bar[c];r<h;r++)
+			mvaddch(TUNE_SPEC_ROW + TUNE_SPEC_ROWS-1 - r, c, '|');
+		for(r=h;r<tune_bar[c];r++)
+			mvaddch(TUNE_SPEC_ROW + TUNE_SPEC_ROWS-1 - r, c, ' ');
+		tune_bar[c] = h;
+	}
+	
+	/* waterfall - one new line at the top */
+	wscrl(tune_wf, -1);
+	for(c=0;c<tune_cols;c++)
+	{
+		h = (tune_db[c] - floor_db) * nr / (TUNE_SPEC_ROWS*TUNE_SPEC_DB_ROW) + 0.5F;
+		h = h < 0 ? 0 : h > nr ? nr : h;
+		mvwaddch(tune_wf, 0, c, tune_wf_ramp[h]);
+	}
+}
+
 /* process command line after <cr> */
 void cmd_proc(void)
 {
@@ -133,6 +437,19 @@ void cmd_proc(void)
 					printf("r820t2_mixer_agc_ena <state> - Enable Mixer AGC [0 / 1]\n");
 					printf("r820t2_bandwidth <bw> - Set IF bandwidth [0 - 15]\n");
 					printf("vhf_freq <frequency> - Set HF & VHF freq in Hz\n");
+					printf("r820t2_plans [fill <start> <stop>|step <Hz>|clear] - tuning plan cache\n");
+					printf("pipeline - audio pipeline ring depth & high water marks\n");
+					printf("stats [reset] - DSP timing & xrun counts\n");
+					printf("rx [<n> on|off|offset|demod|filter|level [<val>]] - list / set up receivers\n");
+					printf("rx <n> phase <0=atan2f,1=poly,2=quad> - Sync AM / NBFM phase detector\n");
+					printf("pfb [on <M>|off|sel <c>|squelch <dB>|demod <c> <0=AM,1=NBFM>] - channelizer\n");
+					printf("agc [<attack ms> <decay ms> <hang ms>] - AGC times for all receivers\n");
+					printf("poll [<Hz>] - FPGA status poll rate, 0 = off\n");
+					printf("hwq - hardware command queue stats\n");
+					printf("scan [<start> <stop> <step>|add <Hz>|clear|start|stop] - scanner\n");
+					printf("scan time <settle ms> <dwell ms>|squelch <dB>|mode <0=stop,1=log> - scanner setup\n");
+					printf("sweep [<start> <stop> <file[.csv]>|fft <N>|settle <ms>|stop] - spectrum sweep\n");
+					printf("spec [on|off|fft <N>|rate <Hz>|avg <n>] - tune screen spectrum\n");
 					printf("quit - exit program\n");
 					break;
 	
@@ -143,8 +460,7 @@ void cmd_proc(void)
 					else
 					{
 						reg = (int)strtoul(argv[1], NULL, 0) & 0x7f;
-						ice_read(bs, reg, &data);
-						printf("spi_read: 0x%02X = 0x%08X\n", reg, data);
+						cmd_hw(hw_spi_read, "spi_read: 0x%02X = 0x%08X\n", reg, 0);
 					}
 					break;
 	
@@ -156,14 +472,13 @@ void cmd_proc(void)
 					{
 						reg = (int)strtoul(argv[1], NULL, 0) & 0x7f;
 						data = strtoul(argv[2], NULL, 0);
-						ice_write(bs, reg, data);
-						printf("spi_write: 0x%02X 0x%08X\n", reg, data);
+						cmd_hw(hw_spi_write, "spi_write: 0x%02X 0x%08X\n", reg, data);
 					}
 					break;
 
 				case CMD_LO_READ:
 					/* lo_read */
-					printf("lo_read: %u Hz\n", rxadc_get_lo());
+					cmd_hw(hw_lo_read, "lo_read: %u Hz\n", 0, 0);
 					break;
 	
 				case CMD_LO_WRITE:
@@ -173,20 +488,25 @@ void cmd_proc(void)
 					else
 					{
 						data = strtoul(argv[1], NULL, 0);
-                        data = rxadc_set_lo(data);
-						printf("lo_write: 0x%08X\n", data);
+						cmd_hw(hw_lo_write, "lo_write: 0x%08X\n", data, 0);
 					}
 					break;
 	
 				case CMD_TUNE:
 					/* Tuning mode */
+					if(scan_active() || sweep_active())
 					{
-						int32_t lo_freq;
-						int rxchar;
+						printf("tune - scan or sweep running, stop it first\n");
+						break;
+					}
+					{
+						int32_t lo_freq, lo_sent;
+						int rxchar, lo_busy = 0;
 						char textbuf[80];
+						uint8_t ifgain, cicsat;
 						
-						/* get current tune value */
-						lo_freq = rxadc_get_lo();
+						/* get current tune value - from the shadow, not the bus */
+						lo_freq = lo_sent = rxadc_peek_lo();
 						
 						/* initialize curses */
 						initscr();
@@ -202,6 +522,9 @@ void cmd_proc(void)
 						mvaddstr(3, 0, "q : next demod");
 						mvaddstr(4, 0, "a : next filter");
 						mvaddstr(4, 40, "+/- : volume");
+						mvaddstr(5, 0, "s : spectrum on/off");
+						if(tune_spec_on)
+							tune_spec_open();
 						
 						while(!exit_program)
 						{
@@ -211,18 +534,19 @@ void cmd_proc(void)
 							if(rxchar == 27)
 								break;
 							
-							/* refresh screen */
+							/* refresh screen - FPGA status from the shadow */
+							rxadc_get_status(&ifgain, &cicsat);
 							sprintf(textbuf, "  LO: %9u Hz  ", lo_freq);
 							mvaddstr(8, 0, textbuf);
-							sprintf(textbuf, "RSSI: % 4d dB  ", Audio_GetRSSI()-6*rxadc_get_ifgain());
+							sprintf(textbuf, "RSSI: % 4d dB  ", Audio_GetRSSI()-6*ifgain);
 							mvaddstr(9, 0, textbuf);
-							sprintf(textbuf, "IF ovl: %d  ", rxadc_get_cicsat());
+							sprintf(textbuf, "IF ovl: %d  ", cicsat);
 							mvaddstr(9, 40, textbuf);
 							sprintf(textbuf, "Mode: %s  ", audio_demod_names[Audio_GetDemod()]);
 							mvaddstr(10, 0, textbuf);
 							sprintf(textbuf, "  BW: %d Hz  ", Audio_GetFilterBW(Audio_GetFilter()));
 							mvaddstr(11, 0, textbuf);
-							sprintf(textbuf, "  IF: %d dB  ", 6*rxadc_get_ifgain());
+							sprintf(textbuf, "  IF: %d dB  ", 6*ifgain);
 							mvaddstr(12, 0, textbuf);
 							sprintf(textbuf, " Vol: %ld  ", play_vol);
 							mvaddstr(12, 40, textbuf);
@@ -234,9 +558,22 @@ void cmd_proc(void)
 							}
 							else
 								mvaddstr(13, 0, "                                   ");
-							mvaddch(14, 0, ' ');
+							stats_line(textbuf, sizeof(textbuf));
+							mvaddstr(14, 0, textbuf);
+							sprintf(textbuf, "Latency: %5.1f ms  max %5.1f ms  ",
+								stats.lat_avg_ms, stats.lat_max_ms);
+							mvaddstr(15, 0, textbuf);
+							if(tune_wf)
+							{
+								tune_spec_axis(lo_freq);
+								tune_spec_draw();
+							}
+							mvaddch(16, 0, ' ');
 								
-							refresh();
+							wnoutrefresh(stdscr);
+							if(tune_wf)
+								wnoutrefresh(tune_wf);
+							doupdate();
 
 							/* act on keypress */
 							if(rxchar != EOF)
@@ -259,21 +596,36 @@ void cmd_proc(void)
 									case 'l': lo_freq -=1; break;
 									case 'q': Audio_SetDemod((Audio_GetDemod()+1)%8); break;
 									case 'a': Audio_SetFilter((Audio_GetFilter()+1)%audio_num_filts); break;
-									case 'z': rxadc_set_ifgain((rxadc_get_ifgain()+1)%8); break;
+									case 'z': cmd_hw(hw_ifgain, NULL, (ifgain+1)%8, 0); break;
 									case '+': play_vol++; play_vol = play_vol>100 ? 100 : play_vol; mixer_set(play_vol); break;
 									case '-': play_vol--; play_vol = play_vol<0 ? 0 : play_vol; mixer_set(play_vol); break;
+									case 's':
+										if(tune_wf)
+											tune_spec_close();
+										else
+											tune_spec_open();
+										break;
 								}
 								lo_freq = lo_freq >= RXADC_FSAMPLE/2 ? RXADC_FSAMPLE/2 : lo_freq;
 								lo_freq = lo_freq < 0 ? 0 : lo_freq;
-								
-								rxadc_set_lo(lo_freq);
 							}
+							
+							tune_lo(lo_freq, &lo_sent, &lo_busy);
 
 							usleep(20000);
 						}
 						
 						/* shut down curses */
+						if(tune_wf)
+							tune_spec_close();
 						endwin();
+						
+						/* let the last retune land before the prompt comes back */
+						while(lo_busy || lo_freq != lo_sent)
+						{
+							tune_lo(lo_freq, &lo_sent, &lo_busy);
+							usleep(1000);
+						}
 					}
 					break;
 	
@@ -300,8 +652,7 @@ void cmd_proc(void)
 					else
 					{
 						reg = (int)strtoul(argv[1], NULL, 0) & 0x3f;
-						data = R820T2_i2c_read_reg_uncached(reg);
-						printf("r820t2_read: 0x%02X = 0x%02X\n", reg, data);
+						cmd_hw(hw_r820_read, "r820t2_read: 0x%02X = 0x%02X\n", reg, 0);
 					}
 					break;
 	
@@ -312,8 +663,7 @@ void cmd_proc(void)
 					{
 						reg = (int)strtoul(argv[1], NULL, 0) & 0x3f;
 						data = strtoul(argv[2], NULL, 0);
-						R820T2_i2c_write_reg(reg, data);
-						printf("r820t2_write: 0x%02X 0x%02X\n", reg, data);
+						cmd_hw(hw_r820_write, "r820t2_write: 0x%02X 0x%02X\n", reg, data);
 					}
 					break;
 		
@@ -323,8 +673,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0);
-						R820T2_set_freq(data);
-						printf("r820t2_freq:  %d\n", data);
+						cmd_hw(hw_r820_freq, "r820t2_freq:  %d\n", data, 0);
 					}
                     break;
                     
@@ -334,8 +683,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x0f;
-						R820T2_set_lna_gain(data);
-						printf("r820t2_lna_gain:  %d\n", data);
+						cmd_hw(hw_r820_lna_gain, "r820t2_lna_gain:  %d\n", data, 0);
 					}
                     break;
                 
@@ -345,8 +693,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x0f;
-						R820T2_set_mixer_gain(data);
-						printf("r820t2_mixer_gain:  %d\n", data);
+						cmd_hw(hw_r820_mixer_gain, "r820t2_mixer_gain:  %d\n", data, 0);
 					}
                     break;
                 
@@ -356,8 +703,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x0f;
-						R820T2_set_vga_gain(data);
-						printf("r820t2_vga_gain:  %d\n", data);
+						cmd_hw(hw_r820_vga_gain, "r820t2_vga_gain:  %d\n", data, 0);
 					}
                     break;
                 
@@ -367,8 +713,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x01;
-						R820T2_set_lna_agc(data);
-						printf("r820t2_lna_agc_ena:  %d\n", data);
+						cmd_hw(hw_r820_lna_agc, "r820t2_lna_agc_ena:  %d\n", data, 0);
 					}
                     break;
                 
@@ -378,8 +723,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x01;
-						R820T2_set_mixer_agc(data);
-						printf("mixer_agc_ena:  %d\n", data);
+						cmd_hw(hw_r820_mixer_agc, "mixer_agc_ena:  %d\n", data, 0);
 					}
                     break;
                 
@@ -389,8 +733,7 @@ void cmd_proc(void)
 					else
 					{
 						data = (int)strtoul(argv[1], NULL, 0) & 0x0f;
-						R820T2_set_if_bandwidth(data);
-						printf("r820t2_bandwidth:  %d\n", data);
+						cmd_hw(hw_r820_bandwidth, "r820t2_bandwidth:  %d\n", data, 0);
 					}
                     break;
 
@@ -399,21 +742,278 @@ void cmd_proc(void)
 						printf("vhf_freq - missing arg(s)\n");
 					else
 					{
-                        /* set VHF freq */
+                        /* set VHF freq & HF Freq to IF */
 						data = (int)strtoul(argv[1], NULL, 0);
-						printf("vhf_freq:  R820T2 freq = %d\n", data);
-						R820T2_set_freq(data);
-                        
-                        /* set HF Freq to IF */
+						cmd_hw(hw_vhf_freq, "vhf_freq:  R820T2 freq = %d\n"
+							"vhf_freq:  DDC IF freq = %d\n", data, 0);
+					}
+                    break;
+
+				case CMD_R820_PLANS:
+					/* tuning plan cache */
+					if(argc < 2)
+						R820T2_plan_report(stdout);
+					else if(strcmp(argv[1], "clear") == 0)
+						cmd_hw(hw_r820_plan_clear, NULL, r820t_plan_step, 0);
+					else if(argc < 3)
+						printf("r820t2_plans - missing arg(s)\n");
+					else if(strcmp(argv[1], "step") == 0)
+						cmd_hw(hw_r820_plan_clear, "r820t2_plans: step %u Hz\n",
+							strtoul(argv[2], NULL, 0), 0);
+					else if(strcmp(argv[1], "fill") == 0 && argc > 3)
+						cmd_hw(hw_r820_plan_fill, "r820t2_plans: from %u Hz, %u plans\n",
+							strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0));
+					else
+						printf("r820t2_plans - unknown setting %s\n", argv[1]);
+					break;
+
+				case CMD_PIPELINE:
+					/* pipeline ring stats */
+					printf("pipeline: ");
+					pipeline_report(stdout);
+					break;
+
+				case CMD_STATS:
+					/* audio path instrumentation */
+					if(argc > 1 && strcmp(argv[1], "reset") == 0)
+					{
+						stats_reset();
+						printf("stats: reset\n");
+					}
+					else
+						stats_report(stdout);
+					break;
+
+				case CMD_RX:
+					/* multiple receivers */
+					if(argc < 3)
+					{
+						printf("rx: %d worker threads\n", Audio_RxWorkers());
+						for(reg=0;reg<AUDIO_MAX_RX;reg++)
+							if(Audio_RxGetEnable(reg))
+								printf("rx %d: offset %d Hz, %s/%s, BW %d Hz, level %.2f, RSSI %d dB\n",
+									reg, Audio_RxGetOffset(reg),
+									audio_demod_names[Audio_RxGetDemod(reg)],
+									audio_phase_names[Audio_RxGetPhaseDet(reg)],
+									Audio_GetFilterBW(Audio_RxGetFilter(reg)),
+									Audio_RxGetLevel(reg), Audio_RxGetRSSI(reg));
+						break;
+					}
+
+					reg = (int)strtoul(argv[1], NULL, 0);
+					if(reg >= AUDIO_MAX_RX)
+						printf("rx - receiver must be 0 - %d\n", AUDIO_MAX_RX-1);
+					else if(strcmp(argv[2], "on") == 0)
+						Audio_RxEnable(reg, 1);
+					else if(strcmp(argv[2], "off") == 0)
+					{
+						if(reg == 0)
+							printf("rx - receiver 0 is always on\n");
+						Audio_RxEnable(reg, 0);
+					}
+					else if(argc < 4)
+						printf("rx - missing arg(s)\n");
+					else if(strcmp(argv[2], "offset") == 0)
+						Audio_RxSetOffset(reg, strtol(argv[3], NULL, 0));
+					else if(strcmp(argv[2], "demod") == 0)
+						Audio_RxSetDemod(reg, strtoul(argv[3], NULL, 0));
+					else if(strcmp(argv[2], "filter") == 0)
+						Audio_RxSetFilter(reg, strtoul(argv[3], NULL, 0));
+					else if(strcmp(argv[2], "level") == 0)
+						Audio_RxSetLevel(reg, strtof(argv[3], NULL));
+					else if(strcmp(argv[2], "phase") == 0)
+						Audio_RxSetPhaseDet(reg, strtoul(argv[3], NULL, 0));
+					else
+						printf("rx - unknown setting %s\n", argv[2]);
+					break;
+
+				case CMD_PFB:
+					/* polyphase channelizer */
+					if(argc < 2)
+					{
+						if(!pfb_get_channels())
 						{
-							rxadc_set_lo(r820t_if_freq);
-                            printf("vhf_freq:  DDC IF freq = %d\n", r820t_if_freq);
+							printf("pfb: off\n");
+							break;
 						}
+						printf("pfb: %d channels, squelch %d dB\n",
+							pfb_get_channels(), pfb_get_squelch());
+						for(reg=0;reg<pfb_get_channels();reg++)
+							printf("pfb %2d: %7d Hz  %-4s % 4d dB%s\n", reg,
+								pfb_chan_freq(reg),
+								pfb_demod_names[pfb_get_demod(reg)],
+								pfb_chan_rssi(reg),
+								reg == pfb_get_select() ? "  <" : "");
 					}
-                    break;
+					else if(strcmp(argv[1], "off") == 0)
+						pfb_set_channels(0);
+					else if(argc < 3)
+						printf("pfb - missing arg(s)\n");
+					else if(strcmp(argv[1], "on") == 0)
+					{
+						pfb_set_channels(strtoul(argv[2], NULL, 0));
+						if(!pfb_get_channels())
+							printf("pfb - channels must be a power of 2 up to %d\n",
+								PFB_MAX_M);
+					}
+					else if(strcmp(argv[1], "sel") == 0)
+						pfb_select(strtoul(argv[2], NULL, 0));
+					else if(strcmp(argv[1], "squelch") == 0)
+						pfb_set_squelch(strtol(argv[2], NULL, 0));
+					else if(strcmp(argv[1], "demod") == 0 && argc > 3)
+						pfb_set_demod(strtoul(argv[2], NULL, 0),
+							strtoul(argv[3], NULL, 0));
+					else
+						printf("pfb - unknown setting %s\n", argv[1]);
+					break;
+
+				case CMD_AGC:
+					/* AGC times */
+					if(argc > 1 && argc < 4)
+						printf("agc - missing arg(s)\n");
+					else
+					{
+						float32_t att, dec, hang;
+
+						if(argc > 3)
+							for(reg=0;reg<AUDIO_MAX_RX;reg++)
+								Audio_RxSetAGC(reg, strtof(argv[1], NULL),
+									strtof(argv[2], NULL), strtof(argv[3], NULL));
+						Audio_RxGetAGC(0, &att, &dec, &hang);
+						printf("agc: attack %.1f ms, decay %.1f ms, hang %.1f ms\n",
+							att, dec, hang);
+					}
+					break;
+
+				case CMD_POLL:
+					/* status poll rate */
+					if(argc > 1)
+						rxadc_poll(strtol(argv[1], NULL, 0));
+					printf("poll: %d Hz, %lu reads cached, %lu writes elided\n",
+						rxadc_poll_hz, rxadc_reads_cached, rxadc_writes_elided);
+					break;
+
+				case CMD_HWQ:
+					/* hardware command queue */
+					hwq_report(stdout);
+					break;
+
+				case CMD_SCAN:
+					/* frequency scanner */
+					if(argc < 2)
+						scan_report(stdout);
+					else if(strcmp(argv[1], "stop") == 0)
+						scan_stop();
+					else if(scan_active())
+						printf("scan - running, scan stop first\n");
+					else if(strcmp(argv[1], "start") == 0)
+					{
+						if(sweep_active())
+							printf("scan - sweep running\n");
+						else if(scan_start(cmd_scan_done))
+							printf("scan - no channels or no hardware worker\n");
+					}
+					else if(strcmp(argv[1], "clear") == 0)
+						scan_clear();
+					else if(argc < 3)
+						printf("scan - missing arg(s)\n");
+					else if(strcmp(argv[1], "add") == 0)
+					{
+						if(scan_add(strtoul(argv[2], NULL, 0)))
+							printf("scan - list full at %d channels\n", SCAN_MAX_CH);
+					}
+					else if(strcmp(argv[1], "squelch") == 0)
+						scan_set_squelch(strtof(argv[2], NULL));
+					else if(strcmp(argv[1], "mode") == 0)
+						scan_set_mode(strtoul(argv[2], NULL, 0));
+					else if(strcmp(argv[1], "time") == 0 && argc > 3)
+						scan_set_time(strtoul(argv[2], NULL, 0),
+							strtoul(argv[3], NULL, 0));
+					else if(argc > 3)
+					{
+						scan_clear();
+						if(scan_range(strtoul(argv[1], NULL, 0),
+							strtoul(argv[2], NULL, 0), strtoul(argv[3], NULL, 0)))
+							printf("scan - bad range or more than %d channels\n",
+								SCAN_MAX_CH);
+						printf("scan: %d channels\n", scan_channels());
+					}
+					else
+						printf("scan - unknown setting %s\n", argv[1]);
+					break;
+
+				case CMD_SWEEP:
+					/* spectrum sweep */
+					if(argc < 2)
+						sweep_report(stdout);
+					else if(strcmp(argv[1], "stop") == 0)
+						sweep_stop();
+					else if(sweep_active() || scan_active())
+						printf("sweep - %s running, stop it first\n",
+							sweep_active() ? "sweep" : "scan");
+					else if(argc < 3)
+						printf("sweep - missing arg(s)\n");
+					else if(strcmp(argv[1], "fft") == 0)
+					{
+						if(sweep_set_fft(strtoul(argv[2], NULL, 0)))
+							printf("sweep - FFT must be a power of 2, %d to %d\n",
+								SWEEP_FFT_MIN, SWEEP_FFT_MAX);
+					}
+					else if(strcmp(argv[1], "settle") == 0)
+						sweep_set_settle(strtoul(argv[2], NULL, 0));
+					else if(argc > 3)
+					{
+						if(sweep_start(strtoul(argv[1], NULL, 0),
+							strtoul(argv[2], NULL, 0), argv[3], cmd_sweep_done))
+							printf("sweep - can't start\n");
+					}
+					else
+						printf("sweep - unknown setting %s\n", argv[1]);
+					break;
+
+				case CMD_SPEC:
+					/* tune screen spectrum */
+					if(argc > 1)
+					{
+						if(strcmp(argv[1], "on") == 0)
+							tune_spec_on = 1;
+						else if(strcmp(argv[1], "off") == 0)
+							tune_spec_on = 0;
+						else if(argc < 3)
+						{
+							printf("spec - missing arg(s)\n");
+							break;
+						}
+						else if(strcmp(argv[1], "fft") == 0)
+						{
+							if(spec_set_fft(strtoul(argv[2], NULL, 0)))
+								printf("spec - FFT must be a power of 2, %d to %d\n",
+									SPEC_FFT_MIN, SPEC_FFT_MAX);
+						}
+						else if(strcmp(argv[1], "rate") == 0)
+						{
+							if(spec_set_rate(strtoul(argv[2], NULL, 0)))
+								printf("spec - rate 1 to %d Hz\n", SPEC_RATE_MAX);
+						}
+						else if(strcmp(argv[1], "avg") == 0)
+						{
+							if(spec_set_avg(strtoul(argv[2], NULL, 0)))
+								printf("spec - average 1 to %d\n", SPEC_AVG_MAX);
+						}
+						else
+						{
+							printf("spec - unknown setting %s\n", argv[1]);
+							break;
+						}
+					}
+					printf("spec: tune screen %s\n", tune_spec_on ? "on" : "off");
+					spec_report(stdout);
+					break;
 
 				case CMD_QUIT:
 					/* bail out */
+					scan_stop();
+					sweep_stop();
 					printf("quit:Goodbye\n");
 					exit_program = 1;
 					break;
@@ -435,6 +1035,19 @@ void init_cmd(void)
 	cmd_prompt();
 }
 
+/* background work from the main loop - finished commands & scan hits */
+void cmd_poll(void)
+{
+	scan_hit h;
+	
+	hwq_reap();
+	while(scan_get_hit(&h))
+	{
+		printf("\rscan: %u Hz  %.1f dB  pass %u\n", h.freq, h.db, h.pass);
+		cmd_reprompt();
+	}
+}
+
 void cmd_parse(char ch)
 {
 	/* accumulate chars until cr, handle backspace */
@@ -8,5 +8,6 @@
 
 void init_cmd(void);
 void cmd_parse(char ch);
+void cmd_poll(void);
 
 #endif
@@ -0,0 +1,126 @@
+/*
+ * fft.c - radix-2 complex FFT
+ * 10-16-26 E. Brombaugh
+ *
+ * In-place decimation in time on split real & imaginary arrays. The
+ * inverse uses conjugate twiddles and is not scaled.
+ */
+
+#include <stdlib.h>
+#include "fft.h"
+
+/*
+ * twiddles & bit reversal for n points into caller's tables - n/2 cs &
+ * sn, n rev. Doesn't allocate so it's safe on the audio thread.
+ */
+int fft_init_static(fft_plan *p, int n, float32_t *cs, float32_t *sn,
+	uint16_t *rev)
+{
+	int i, j, b;
+
+	/* must be a power of 2 */
+	if(n < 2 || n > 65536 || (n & (n-1)))
+		return 1;
+
+	p->n = n;
+	for(p->log2n=0;(1<<p->log2n)<n;p->log2n++);
+	p->cs = cs;
+	p->sn = sn;
+	p->rev = rev;
+
+	for(i=0;i<n/2;i++)
+	{
+		p->cs[i] = cosf(2.0F*PI*(float32_t)i/(float32_t)n);
+		p->sn[i] = -sinf(2.0F*PI*(float32_t)i/(float32_t)n);
+	}
+
+	for(i=0;i<n;i++)
+	{
+		for(j=0,b=0;b<p->log2n;b++)
+			j |= ((i>>b)&1) << (p->log2n-1-b);
+		p->rev[i] = j;
+	}
+
+	return 0;
+}
+
+/*
+ * set up twiddles & bit reversal for n points
+ */
+int fft_init(fft_plan *p, int n)
+{
+	float32_t *cs, *sn;
+	uint16_t *rev;
+
+	p->cs = p->sn = NULL;
+	p->rev = NULL;
+
+	/* must be a power of 2 */
+	if(n < 2 || n > 65536 || (n & (n-1)))
+		return 1;
+
+	cs = (float32_t *)malloc(n/2 * sizeof(float32_t));
+	sn = (float32_t *)malloc(n/2 * sizeof(float32_t));
+	rev = (uint16_t *)malloc(n * sizeof(uint16_t));
+	if(!cs || !sn || !rev)
+	{
+		free(cs);
+		free(sn);
+		free(rev);
+		return 1;
+	}
+
+	return fft_init_static(p, n, cs, sn, rev);
+}
+
+/*
+ * release tables
+ */
+void fft_free(fft_plan *p)
+{
+	free(p->cs);
+	free(p->sn);
+	free(p->rev);
+	p->cs = p->sn = NULL;
+	p->rev = NULL;
+}
+
+/*
+ * transform in place
+ */
+void fft_run(fft_plan *p, float32_t *re, float32_t *im, int inverse)
+{
+	int n = p->n, half, step, i, j, k;
+	float32_t tr, ti, wr, wi;
+
+	/* bit reverse */
+	for(i=0;i<n;i++)
+	{
+		j = p->rev[i];
+		if(j > i)
+		{
+			tr = re[i]; re[i] = re[j]; re[j] = tr;
+			ti = im[i]; im[i] = im[j]; im[j] = ti;
+		}
+	}
+
+	/* butterflies */
+	for(half=1,step=n/2;half<n;half<<=1,step>>=1)
+	{
+		for(k=0;k<half;k++)
+		{
+			wr = p->cs[k*step];
+			wi = inverse ? -p->sn[k*step] : p->sn[k*step];
+			for(i=k;i<n;i+=2*half)
+			{
+				j = i + half;
+				tr = re[j]*wr - im[j]*wi;
+				ti = re[j]*wi + im[j]*wr;
+				re[j] = re[i] - tr;
+				im[j] = im[i] - ti;
+				re[i] += tr;
+				im[i] += ti;
+			}
+		}
+	}
+}
@@ -0,0 +1,25 @@
+/*
+ * fft.h - radix-2 complex FFT
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __fft__
+#define __fft__
+
+#include "main.h"
+
+typedef struct
+{
+	int n;					/* points, power of 2 */
+	int log2n;
+	float32_t *cs, *sn;		/* n/2 twiddles */
+	uint16_t *rev;			/* bit reversal table */
+} fft_plan;
+
+int fft_init(fft_plan *p, int n);
+int fft_init_static(fft_plan *p, int n, float32_t *cs, float32_t *sn,
+	uint16_t *rev);
+void fft_free(fft_plan *p);
+void fft_run(fft_plan *p, float32_t *re, float32_t *im, int inverse);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * hwq.c - hardware command queue serviced by one worker thread
+ * 10-16-26 E. Brombaugh
+ *
+ * The control thread allocates commands, submits them and later reaps
+ * them, so the pool needs no locking. The worker takes commands off one
+ * ring, runs them in order and hands them back on another; slow tuner
+ * operations then never hold up parsing or the screen.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hwq.h"
+#include "ring.h"
+
+static hwq_cmd hwq_pool[HWQ_SIZE], *hwq_free;
+static spsc_ring hwq_cmd_ring, hwq_done_ring;
+static pthread_t hwq_thread;
+static volatile int hwq_exit;
+static int hwq_running, hwq_inflight, hwq_pool_ready;
+static unsigned long hwq_count;
+static float hwq_max_ms, hwq_tot_ms;
+
+/*
+ * monotonic time in ns
+ */
+static uint64_t hwq_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * worker - run commands in submission order
+ */
+static void *hwq_worker(void *arg)
+{
+	hwq_cmd *c;
+
+	while(!hwq_exit)
+	{
+		if((c = ring_wait(&hwq_cmd_ring, 100)) == NULL)
+			continue;
+		c->run(c);
+		c->ms = (hwq_now() - c->t_submit) * 1e-6F;
+		ring_put(&hwq_done_ring, c);
+	}
+
+	return NULL;
+}
+
+/*
+ * put every command on the free list
+ */
+static void hwq_pool_init(void)
+{
+	int i;
+
+	hwq_free = NULL;
+	for(i=HWQ_SIZE-1;i>=0;i--)
+	{
+		hwq_pool[i].next = hwq_free;
+		hwq_free = &hwq_pool[i];
+	}
+	hwq_inflight = 0;
+	hwq_pool_ready = 1;
+}
+
+/*
+ * start the worker - without it commands run inline in hwq_submit()
+ */
+int hwq_start(void)
+{
+	if(!hwq_pool_ready)
+		hwq_pool_init();
+
+	if(ring_init(&hwq_cmd_ring, HWQ_SIZE) || ring_init(&hwq_done_ring, HWQ_SIZE))
+	{
+		fprintf(stderr, "hwq_start: can't allocate rings\n");
+		return 1;
+	}
+
+	hwq_exit = 0;
+	if(pthread_create(&hwq_thread, NULL, hwq_worker, NULL))
+	{
+		fprintf(stderr, "hwq_start: can't start worker\n");
+		ring_free(&hwq_cmd_ring);
+		ring_free(&hwq_done_ring);
+		return 1;
+	}
+	hwq_running = 1;
+	return 0;
+}
+
+/*
+ * finish what's queued, report it & stop the worker
+ */
+void hwq_stop(void)
+{
+	if(!hwq_running)
+		return;
+
+	while(hwq_pending())
+	{
+		hwq_reap();
+		usleep(1000);
+	}
+	hwq_exit = 1;
+	pthread_join(hwq_thread, NULL);
+	ring_free(&hwq_cmd_ring);
+	ring_free(&hwq_done_ring);
+	hwq_running = 0;
+}
+
+/*
+ * get a blank command - NULL if the pool is used up
+ */
+hwq_cmd *hwq_alloc(void)
+{
+	hwq_cmd *c;
+
+	if(!hwq_pool_ready)
+		hwq_pool_init();
+	if((c = hwq_free) == NULL)
+		return NULL;
+	hwq_free = c->next;
+
+	c->run = NULL;
+	c->done = NULL;
+	c->fmt = NULL;
+	c->ctx = NULL;
+	c->arg[0] = c->arg[1] = 0;
+	return c;
+}
+
+/*
+ * report a finished command & put it back in the pool
+ */
+static void hwq_finish(hwq_cmd *c)
+{
+	if(c->done)
+		c->done(c);
+	hwq_count++;
+	hwq_tot_ms += c->ms;
+	if(c->ms > hwq_max_ms)
+		hwq_max_ms = c->ms;
+
+	c->next = hwq_free;
+	hwq_free = c;
+	hwq_inflight--;
+}
+
+/*
+ * hand a command to the worker. done() is called from hwq_reap() once
+ * it has run. Without a worker the command runs & reports right away.
+ */
+int hwq_submit(hwq_cmd *c)
+{
+	c->t_submit = hwq_now();
+	hwq_inflight++;
+	if(!hwq_running)
+	{
+		c->run(c);
+		c->ms = (hwq_now() - c->t_submit) * 1e-6F;
+		hwq_finish(c);
+		return 0;
+	}
+	return ring_put(&hwq_cmd_ring, c);
+}
+
+/*
+ * report finished commands & recycle them - control thread only
+ */
+int hwq_reap(void)
+{
+	hwq_cmd *c;
+	int n = 0;
+
+	if(!hwq_running)
+		return 0;
+	while((c = ring_get(&hwq_done_ring)) != NULL)
+	{
+		hwq_finish(c);
+		n++;
+	}
+	return n;
+}
+
+/*
+ * commands submitted but not yet reaped
+ */
+int hwq_pending(void)
+{
+	return hwq_inflight;
+}
+
+/*
+ * commands go to the worker rather than running inline
+ */
+int hwq_async(void)
+{
+	return hwq_running;
+}
+
+/*
+ * one line summary
+ */
+void hwq_report(FILE *fd)
+{
+	fprintf(fd, "hwq: %lu commands, %d pending, avg %.2f ms, max %.2f ms\n",
+		hwq_count, hwq_inflight, hwq_count ? hwq_tot_ms / hwq_count : 0.0F,
+		hwq_max_ms);
+}
@@ -0,0 +1,37 @@
+/*
+ * hwq.h - hardware command queue serviced by one worker thread
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __hwq__
+#define __hwq__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* commands in flight + awaiting report */
+#define HWQ_SIZE 32
+
+typedef struct hwq_cmd hwq_cmd;
+struct hwq_cmd
+{
+	void (*run)(hwq_cmd *c);	/* worker thread - does the SPI / I2C work */
+	void (*done)(hwq_cmd *c);	/* control thread - reports, may be NULL */
+	const char *fmt;			/* report format for done, given arg[0..1] */
+	void *ctx;					/* caller's completion state */
+	uint32_t arg[2];			/* parameters in, results out */
+	float ms;					/* submit to completion */
+	uint64_t t_submit;
+	hwq_cmd *next;				/* free list */
+};
+
+int hwq_start(void);
+void hwq_stop(void);
+hwq_cmd *hwq_alloc(void);
+int hwq_submit(hwq_cmd *c);
+int hwq_reap(void);
+int hwq_pending(void);
+int hwq_async(void);
+void hwq_report(FILE *fd);
+
+#endif
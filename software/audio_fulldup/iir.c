@@ -3,15 +3,24 @@
  * 07-14-2015 E. Brombaugh
  */
 
+#include <stdio.h>
 #include "iir.h"
+#include "iir_kern.h"
 
 /*
- * initialize the iir structure
+ * initialize the iir structure - returns 1 if there are more sections
+ * than the block kernel handles
  */
-void iir_init(iir *is, bq_state *s, bq_coeffs *c, uint8_t n)
+int iir_init(iir *is, bq_state *s, bq_coeffs *c, uint8_t n)
 {
 	uint8_t i;
 	
+	if(n > IIR_MAX_BQ)
+	{
+		fprintf(stderr, "iir_init: %d sections, max %d\n", n, IIR_MAX_BQ);
+		return 1;
+	}
+
 	/* set up the structure */
 	is->num_bq = n;
 	is->bqs = s;
@@ -24,6 +33,7 @@ void iir_init(iir *is, bq_state *s, bq_coeffs *c, uint8_t n)
 		s->state[1] = 0;
 		s++;
 	}
+	return 0;
 }
 
 /*
@@ -53,3 +63,21 @@ float32_t iir_calc(iir *is, float32_t input)
 	}
 	return xin;
 }
+
+/*
+ * compute the iir over a block of I & Q in place. Both filters must share
+ * the same coefficients. For planar data pass separate I & Q arrays with
+ * stride 1, for interleaved data pass buf, buf+1 with stride 2.
+ */
+void iir_calc_block_iq(iir *is_i, iir *is_q, float32_t *i, float32_t *q,
+	int n, int stride)
+{
+	const bq_coeffs *c = is_i->bqc;
+	float32_t *si = is_i->bqs->state, *sq = is_q->bqs->state;
+
+	/* constant section count lets the compiler unroll the cascade */
+	if(is_i->num_bq == 3)
+		iir_iq_cascade(c, 3, si, sq, i, q, n, stride);
+	else
+		iir_iq_cascade(c, is_i->num_bq, si, sq, i, q, n, stride);
+}
@@ -31,8 +31,13 @@ typedef struct
 	bq_coeffs *bqc;		/* pointer to array of biquad coeffs	*/
 } iir;
 
+/* max biquads - iir_init() refuses more, the block I/Q kernel's limit */
+#define IIR_MAX_BQ 8
+
 /* iir functions */
-void iir_init(iir *is, bq_state *s, bq_coeffs *c, uint8_t n);
+int iir_init(iir *is, bq_state *s, bq_coeffs *c, uint8_t n);
 float32_t iir_calc(iir *is, float32_t input);
+void iir_calc_block_iq(iir *is_i, iir *is_q, float32_t *i, float32_t *q,
+	int n, int stride);
 
 #endif
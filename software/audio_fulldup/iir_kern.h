@@ -0,0 +1,182 @@
+/*
+ * iir_kern.h - inline I/Q biquad cascade kernels
+ * 10-16-26 E. Brombaugh
+ *
+ * Shared by iir.c and the demod kernels in audio.c so a constant section
+ * count can be propagated into the cascade and fully unrolled.
+ */
+
+#ifndef __iir_kern__
+#define __iir_kern__
+
+#include "iir.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IIR_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define IIR_SSE
+#endif
+
+#if defined(IIR_NEON)
+/*
+ * I/Q cascade with I in lane 0 and Q in lane 1
+ */
+static inline void iir_iq_cascade(const bq_coeffs *c, uint8_t nbq,
+	float32_t *si, float32_t *sq, float32_t *i, float32_t *q, int n,
+	int stride)
+{
+	float32x2_t s0[IIR_MAX_BQ], s1[IIR_MAX_BQ], x, y;
+	uint8_t j;
+	int k;
+
+	/* load state into lanes */
+	for(j=0;j<nbq;j++)
+	{
+		s0[j] = vset_lane_f32(sq[2*j], vdup_n_f32(si[2*j]), 1);
+		s1[j] = vset_lane_f32(sq[2*j+1], vdup_n_f32(si[2*j+1]), 1);
+	}
+
+	for(k=0;k<n;k++)
+	{
+		x = vset_lane_f32(*q, vdup_n_f32(*i), 1);
+		for(j=0;j<nbq;j++)
+		{
+			/* transpose direct form II biquad  */
+			y = vadd_f32(vmul_n_f32(x, c[j].num[0]), s0[j]);
+			s0[j] = vsub_f32(vadd_f32(s1[j], vmul_n_f32(x, c[j].num[1])),
+				vmul_n_f32(y, c[j].den[1]));
+			s1[j] = vsub_f32(vmul_n_f32(x, c[j].num[2]),
+				vmul_n_f32(y, c[j].den[2]));
+			x = vmul_n_f32(y, c[j].gain);
+		}
+		*i = vget_lane_f32(x, 0);
+		*q = vget_lane_f32(x, 1);
+		i += stride;
+		q += stride;
+	}
+
+	/* write state back */
+	for(j=0;j<nbq;j++)
+	{
+		si[2*j] = vget_lane_f32(s0[j], 0);
+		sq[2*j] = vget_lane_f32(s0[j], 1);
+		si[2*j+1] = vget_lane_f32(s1[j], 0);
+		sq[2*j+1] = vget_lane_f32(s1[j], 1);
+	}
+}
+#elif defined(IIR_SSE)
+/*
+ * I/Q cascade with I in lane 0 and Q in lane 1
+ */
+static inline void iir_iq_cascade(const bq_coeffs *c, uint8_t nbq,
+	float32_t *si, float32_t *sq, float32_t *i, float32_t *q, int n,
+	int stride)
+{
+	__m128 s0[IIR_MAX_BQ], s1[IIR_MAX_BQ], x, y;
+	__m128 n0[IIR_MAX_BQ], n1[IIR_MAX_BQ], n2[IIR_MAX_BQ];
+	__m128 d1[IIR_MAX_BQ], d2[IIR_MAX_BQ], g[IIR_MAX_BQ];
+	uint8_t j;
+	int k;
+
+	/* load state into lanes & broadcast coeffs */
+	for(j=0;j<nbq;j++)
+	{
+		s0[j] = _mm_setr_ps(si[2*j], sq[2*j], 0.0F, 0.0F);
+		s1[j] = _mm_setr_ps(si[2*j+1], sq[2*j+1], 0.0F, 0.0F);
+		n0[j] = _mm_set1_ps(c[j].num[0]);
+		n1[j] = _mm_set1_ps(c[j].num[1]);
+		n2[j] = _mm_set1_ps(c[j].num[2]);
+		d1[j] = _mm_set1_ps(c[j].den[1]);
+		d2[j] = _mm_set1_ps(c[j].den[2]);
+		g[j] = _mm_set1_ps(c[j].gain);
+	}
+
+	for(k=0;k<n;k++)
+	{
+		x = _mm_unpacklo_ps(_mm_load_ss(i), _mm_load_ss(q));
+		for(j=0;j<nbq;j++)
+		{
+			/* transpose direct form II biquad  */
+			y = _mm_add_ps(_mm_mul_ps(n0[j], x), s0[j]);
+			s0[j] = _mm_sub_ps(_mm_add_ps(s1[j], _mm_mul_ps(n1[j], x)),
+				_mm_mul_ps(d1[j], y));
+			s1[j] = _mm_sub_ps(_mm_mul_ps(n2[j], x), _mm_mul_ps(d2[j], y));
+			x = _mm_mul_ps(y, g[j]);
+		}
+		_mm_store_ss(i, x);
+		_mm_store_ss(q, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+		i += stride;
+		q += stride;
+	}
+
+	/* write state back */
+	for(j=0;j<nbq;j++)
+	{
+		float32_t tmp[4];
+
+		_mm_storeu_ps(tmp, s0[j]);
+		si[2*j] = tmp[0];
+		sq[2*j] = tmp[1];
+		_mm_storeu_ps(tmp, s1[j]);
+		si[2*j+1] = tmp[0];
+		sq[2*j+1] = tmp[1];
+	}
+}
+#else
+/*
+ * I/Q cascade - scalar fallback with both chains interleaved
+ */
+static inline void iir_iq_cascade(const bq_coeffs *c, uint8_t nbq,
+	float32_t *si, float32_t *sq, float32_t *i, float32_t *q, int n,
+	int stride)
+{
+	float32_t s0i[IIR_MAX_BQ], s1i[IIR_MAX_BQ], s0q[IIR_MAX_BQ], s1q[IIR_MAX_BQ];
+	float32_t xi, xq, yi, yq;
+	uint8_t j;
+	int k;
+
+	/* load state */
+	for(j=0;j<nbq;j++)
+	{
+		s0i[j] = si[2*j];
+		s1i[j] = si[2*j+1];
+		s0q[j] = sq[2*j];
+		s1q[j] = sq[2*j+1];
+	}
+
+	for(k=0;k<n;k++)
+	{
+		xi = *i;
+		xq = *q;
+		for(j=0;j<nbq;j++)
+		{
+			/* transpose direct form II biquad  */
+			yi = c[j].num[0]*xi + s0i[j];
+			yq = c[j].num[0]*xq + s0q[j];
+			s0i[j] = s1i[j] + c[j].num[1] * xi - c[j].den[1] * yi;
+			s0q[j] = s1q[j] + c[j].num[1] * xq - c[j].den[1] * yq;
+			s1i[j] = c[j].num[2] * xi - c[j].den[2] * yi;
+			s1q[j] = c[j].num[2] * xq - c[j].den[2] * yq;
+			xi = yi * c[j].gain;
+			xq = yq * c[j].gain;
+		}
+		*i = xi;
+		*q = xq;
+		i += stride;
+		q += stride;
+	}
+
+	/* write state back */
+	for(j=0;j<nbq;j++)
+	{
+		si[2*j] = s0i[j];
+		si[2*j+1] = s1i[j];
+		sq[2*j] = s0q[j];
+		sq[2*j+1] = s1q[j];
+	}
+}
+#endif
+
+#endif
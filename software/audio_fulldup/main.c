@@ -5,12 +5,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 #include <errno.h>
 #include <poll.h>
 #include <signal.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
 #include <alsa/asoundlib.h>
 #include <pthread.h>
 #include "main.h"
@@ -20,6 +22,14 @@
 #include "shared_i2c.h"
 #include "r820t2.h"
 #include "si5351.h"
+#include "ring.h"
+#include "backend.h"
+#include "replay.h"
+#include "stats.h"
+#include "rt.h"
+#include "hwq.h"
+#include "scan.h"
+#include "sweep.h"
 
 /* version */
 const char *swVersionStr = "V0.1";
@@ -31,6 +41,9 @@ const char *btime = __TIME__;
 /* constants */
 const int legal_rates[3] = {44100, 48000, 88200};
 
+/* shortest period allowed in low latency mode */
+#define LATENCY_MIN_FRAMES 64
+
 /* state */
 iceblk *bs;
 int					demod = DEMOD_AM;
@@ -53,19 +66,40 @@ int 				err;
 int					exit_program = 0;
 long				play_vol = 80;
 int					vhf = 0;
+int					mmap_mode = 0;
+char				*replay_in_name = NULL, *replay_out_name = NULL;
+const audio_backend	*backend;
 char				*rdbuf;
 unsigned int		fragments = 2;
+int					latency_ms = 0;
+int					mlock_mode = 0;
+uint32_t			cfg_speed = ICE_CFG_HZ;
 int					frame_size;
 snd_pcm_uframes_t   frames, inframes, outframes;
 
+/* capture -> DSP -> playback pipeline */
+typedef struct
+{
+	snd_pcm_sframes_t frames;	/* valid frames in buf */
+	char *buf;					/* buffer_size bytes */
+} pcm_block;
+
+unsigned int		pipeline_blocks = 0;
+pcm_block			*blk_pool, drop_blk;
+spsc_ring			free_ring, cap_ring, play_ring;
+unsigned long		pipeline_drops;
+atomic_ullong		pipeline_cap_zero;	/* owned by capture */
+pthread_t			cap_thread, dsp_thread, play_thread;
+
 /*
  * set up an audio device
  */
 int configure_alsa_audio(snd_pcm_t *device, int channels)
 {
 	snd_pcm_hw_params_t *hw_params;
-	int                 err;
+	int                 err, dir = 0;
 	unsigned int		tmp;
+	snd_pcm_uframes_t	min;
 
 	/* allocate memory for hardware parameter structure */ 
 	if((err = snd_pcm_hw_params_malloc(&hw_params)) < 0)
@@ -85,6 +119,7 @@ int configure_alsa_audio(snd_pcm_t *device, int channels)
 
 	/* set access type, sample rate, sample format, channels */
 	if((err = snd_pcm_hw_params_set_access(device, hw_params,
+		mmap_mode ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
 		SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
 	{
 		fprintf (stderr, "cannot set access type: %s\n",
@@ -133,6 +168,25 @@ int configure_alsa_audio(snd_pcm_t *device, int channels)
 	}
 
 	frame_size = channels * (bits / 8);
+	if(latency_ms)
+	{
+		/* smallest period near the request the device will do */
+		frames = buffer_size / frame_size;
+		if((err = snd_pcm_hw_params_get_period_size_min(hw_params, &min,
+			&dir)) == 0 && frames < min)
+			frames = min;
+		if(frames < LATENCY_MIN_FRAMES)
+			frames = LATENCY_MIN_FRAMES;
+		dir = 0;
+		if((err = snd_pcm_hw_params_set_period_size_near(device, hw_params,
+			&frames, &dir)) < 0)
+		{
+			fprintf(stderr, "Error setting period %lu frames: %s\n", frames,
+				snd_strerror(err));
+			return 1;
+		}
+		buffer_size = frames * frame_size;
+	}
 	frames = buffer_size / frame_size * fragments;
 	if((err = snd_pcm_hw_params_set_buffer_size_near(device, hw_params,
 		&frames)) < 0)
@@ -168,82 +222,587 @@ void handle_signals(int s)
 	exit_program = 1;
 }
 
+/*
+ * initialize the mixer
+ */
+void mixer_init(void)
+{
+	const char *card = "default";
+	const char *selem_name = "Master";
+
+	snd_mixer_open(&mixer_handle, 0);
+	snd_mixer_attach(mixer_handle, card);
+	snd_mixer_selem_register(mixer_handle, NULL, NULL);
+	snd_mixer_load(mixer_handle);
+
+	snd_mixer_selem_id_alloca(&sid);
+	snd_mixer_selem_id_set_index(sid, 0);
+	snd_mixer_selem_id_set_name(sid, selem_name);
+	elem = snd_mixer_find_selem(mixer_handle, sid);
+}
+
+/*
+ * set mixer main level
+ */
+void mixer_set(long volume)
+{
+	long min, max;
+
+	snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+	snd_mixer_selem_set_playback_volume_all(elem, volume * max / 100);	
+}
+
+/*
+ * count a PCM error & try to recover the stream
+ */
+static int pcm_recover(snd_pcm_t *handle, int dir, int err)
+{
+	stats_pcm_err(dir, err);
+	if((err = snd_pcm_recover(handle, err, 1)))
+	{
+		stats.pcm[dir].recover_fails++;
+		fprintf(stderr, "%s recover failed: %s\n",
+			dir == STATS_CAPTURE ? "Input" : "Output", snd_strerror(err));
+	}
+	else
+		stats.pcm[dir].recovers++;
+
+	return err;
+}
+
+/*
+ * capture to playback latency for the first frame of a period, measured
+ * after it's been written - input still waiting to be read, output queued
+ * (which already includes this period) & any frames in flight in between.
+ * cap_delay < 0 measures the capture side here too.
+ */
+static void measure_latency(snd_pcm_sframes_t cap_delay,
+	snd_pcm_sframes_t in_flight)
+{
+	snd_pcm_sframes_t play_delay;
+
+	if(cap_delay < 0 && snd_pcm_delay(capture_handle, &cap_delay) < 0)
+		return;
+	if(snd_pcm_delay(playback_handle, &play_delay) < 0)
+		return;
+	stats_latency(cap_delay + play_delay + in_flight);
+}
+
 /*
  * audio thread
  */
 void *audio_thread_handler(void *ptr)
 {
+	long n;
+
 	/* processing loop */
 	fprintf(stderr, "Starting Audio Thread\n");
 	while(!exit_program)
 	{
+		/* get input */
+		if((n = backend->read(rdbuf, frames)) <= 0)
+			continue;
+
+		/* now processes the frames */
+		Audio_Process(rdbuf, n);
+
+		backend->write(rdbuf, n);
+		measure_latency(-1, 0);
+	}
+	
+	fprintf(stderr, "Audio Thread Quitting.\n");
+	return NULL;
+}
+
+/*
+ * ALSA backend - open & configure both devices
+ */
+static int alsa_open(void)
+{
+	/* open input and output devices */
+	if((err = snd_pcm_open(&capture_handle, snd_device_in, SND_PCM_STREAM_CAPTURE, 0)) < 0)
+	{
+		fprintf(stderr, "cannot open input audio device %s: %s\n", snd_device_in, snd_strerror(err));
+		return 1;
+	}
+
+	if((err = snd_pcm_open(&playback_handle, snd_device_out, SND_PCM_STREAM_PLAYBACK, 0)) < 0)
+	{
+		fprintf(stderr, "cannot open output audio device %s: %s\n", snd_device_out, snd_strerror(err));
+		snd_pcm_close(capture_handle);
+		return 1;
+	}
+	
+	/* set up both devices identically */
+	if(mmap_mode)
+	{
+		if(configure_alsa_audio(capture_handle,  nchannels) ||
+			configure_alsa_audio(playback_handle, nchannels))
+		{
+			/* fall back to read/write on both */
+			fprintf(stderr, "mmap access not available - using read/write\n");
+			mmap_mode = 0;
+		}
+		else if(pipeline_blocks)
+		{
+			fprintf(stderr, "mmap mode is single-threaded - ignoring -P\n");
+			pipeline_blocks = 0;
+		}
+	}
+	if(!mmap_mode)
+	{
+		configure_alsa_audio(capture_handle,  nchannels);
+		configure_alsa_audio(playback_handle, nchannels);
+	}
+	
+	/* init the mixer */
+	mixer_init();
+	mixer_set(play_vol);
+
+	return 0;
+}
+
+/*
+ * ALSA backend - get input & handle errors
+ */
+static long alsa_read(char *buf, unsigned long n)
+{
+	while((long)(inframes = snd_pcm_readi(capture_handle, buf, n)) < 0)
+	{
+		if(inframes == -EAGAIN)
+			continue;
+		
+		pcm_recover(capture_handle, STATS_CAPTURE, (int)inframes);
+	}
+	
+	if(inframes != n)
+	{
+		stats.pcm[STATS_CAPTURE].shorts++;
+		fprintf(stderr, "Short read from capture device: %lu != %lu\n",
+			inframes, n);
+	}
+
+	return inframes;
+}
+
+/*
+ * ALSA backend - send output & handle errors
+ */
+static long alsa_write(char *buf, unsigned long n)
+{
+	while((long)(outframes = snd_pcm_writei(playback_handle, buf, n)) < 0)
+	{
+		if (outframes == -EAGAIN)
+			continue;
+		
+		pcm_recover(playback_handle, STATS_PLAYBACK, (int)outframes);
+	}
+	
+	if (outframes != n)
+	{
+		stats.pcm[STATS_PLAYBACK].shorts++;
+		fprintf(stderr, "Short write to playback device: %lu != %lu\n",
+			outframes, n);
+	}
+
+	return outframes;
+}
+
+/*
+ * ALSA backend - shut down
+ */
+static void alsa_close(void)
+{
+	snd_pcm_drain(playback_handle);
+	snd_pcm_drop(capture_handle);
+	snd_mixer_close(mixer_handle);
+	snd_pcm_close(playback_handle);
+	snd_pcm_close(capture_handle);
+}
+
+const audio_backend alsa_backend =
+{
+	"alsa",
+	alsa_open,
+	alsa_read,
+	alsa_write,
+	alsa_close
+};
+
+/*
+ * offline replay - run the receive chain as fast as possible
+ */
+int replay_run(void)
+{
+	struct timespec t0, t1, d0, d1;
+	double wall, dsp = 0.0;
+	unsigned long total = 0;
+	long n;
+
+	backend = &replay_backend;
+	replay_set_files(replay_in_name, replay_out_name);
+	if(backend->open())
+		return 1;
+
+	/* set up sizes */
+	frame_size = nchannels * (bits / 8);
+	frames = buffer_size / frame_size;
+	rdbuf = (char *)malloc(buffer_size);
+
+	/* set up audio processing */
+	Audio_Init();
+	Audio_SetDemod(demod);
+	Audio_SetFilter(filter);
+	fprintf(stderr, "replay: %s -> %s, Demod: %s, Filter: %d Hz, %lu frames/buffer\n",
+		replay_in_name, replay_out_name ? replay_out_name : "(none)",
+		audio_demod_names[demod], Audio_GetFilterBW(filter), frames);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while(!exit_program && (n = backend->read(rdbuf, frames)) > 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &d0);
+		Audio_Process(rdbuf, n);
+		clock_gettime(CLOCK_MONOTONIC, &d1);
+		dsp += (d1.tv_sec - d0.tv_sec) + (d1.tv_nsec - d0.tv_nsec) * 1e-9;
+
+		backend->write(rdbuf, n);
+		total += n;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	backend->close();
+	free(rdbuf);
+
+	/* throughput in complex samples */
+	fprintf(stderr, "replay: %lu frames (%.2f s @ %d Hz) in %.3f s\n",
+		total, (double)total / sample_rate, sample_rate, wall);
+	if(dsp > 0.0)
+		fprintf(stderr, "replay: DSP %.3f Msamples/s (%.1fx realtime), overall %.3f Msamples/s\n",
+			total / dsp * 1e-6, total / dsp / sample_rate,
+			wall > 0.0 ? total / wall * 1e-6 : 0.0);
+
+	return 0;
+}
+
+/*
+ * address of a frame in an interleaved mmap area
+ */
+static char *mmap_area_ptr(const snd_pcm_channel_area_t *area,
+	snd_pcm_uframes_t offset)
+{
+	return (char *)area->addr + (area->first + offset * area->step) / 8;
+}
+
+/*
+ * restart capture after an error
+ */
+static void mmap_capture_recover(int err)
+{
+	if(!pcm_recover(capture_handle, STATS_CAPTURE, err))
+		snd_pcm_start(capture_handle);
+}
+
+/*
+ * mmap audio thread - processes straight from the capture ring buffer
+ * into the playback ring buffer
+ */
+void *mmap_thread_handler(void *ptr)
+{
+	const snd_pcm_channel_area_t *cap_areas, *play_areas;
+	snd_pcm_uframes_t cap_off, play_off, n, pn;
+	snd_pcm_sframes_t avail, committed;
+	int err;
+
+	/* playback was primed & started by main, capture starts here */
+	snd_pcm_start(capture_handle);
+
+	fprintf(stderr, "Starting mmap Audio Thread\n");
+	while(!exit_program)
+	{
+		/* wait for a period of input */
+		if((err = snd_pcm_wait(capture_handle, 1000)) < 0)
+		{
+			mmap_capture_recover(err);
+			continue;
+		}
+
+		if((avail = snd_pcm_avail_update(capture_handle)) < 0)
+		{
+			mmap_capture_recover((int)avail);
+			continue;
+		}
+		if(avail < frames)
+			continue;
+
+		if((avail = snd_pcm_avail_update(playback_handle)) < 0)
+		{
+			/* underrun - prepare & let the commits below refill it */
+			pcm_recover(playback_handle, STATS_PLAYBACK, (int)avail);
+			continue;
+		}
+		if(avail < frames)
+		{
+			/* no room for a period yet - sleep until playback drains */
+			if((err = snd_pcm_wait(playback_handle, 1000)) < 0)
+				pcm_recover(playback_handle, STATS_PLAYBACK, err);
+			continue;
+		}
+
+		/* map one period of both - may come back short at the wrap */
+		n = frames;
+		if((err = snd_pcm_mmap_begin(capture_handle, &cap_areas, &cap_off, &n)) < 0)
+		{
+			mmap_capture_recover(err);
+			continue;
+		}
+		pn = n;
+		if((err = snd_pcm_mmap_begin(playback_handle, &play_areas, &play_off, &pn)) < 0)
+		{
+			snd_pcm_mmap_commit(capture_handle, cap_off, 0);
+			pcm_recover(playback_handle, STATS_PLAYBACK, err);
+			continue;
+		}
+		n = pn < n ? pn : n;
+
+		/* now processes the frames */
+		Audio_ProcessIO(mmap_area_ptr(cap_areas, cap_off),
+			mmap_area_ptr(play_areas, play_off), n);
+
+		committed = snd_pcm_mmap_commit(playback_handle, play_off, n);
+		if(committed < 0 || committed != n)
+			pcm_recover(playback_handle, STATS_PLAYBACK,
+				committed < 0 ? (int)committed : -EPIPE);
+
+		committed = snd_pcm_mmap_commit(capture_handle, cap_off, n);
+		if(committed < 0 || committed != n)
+			mmap_capture_recover(committed < 0 ? (int)committed : -EPIPE);
+		else
+			measure_latency(-1, 0);
+	}
+
+	fprintf(stderr, "mmap Audio Thread Quitting.\n");
+	return NULL;
+}
+
+/*
+ * monotonic time in ns
+ */
+static unsigned long long pipeline_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * pipeline capture thread - never waits on DSP or playback
+ */
+void *capture_thread_handler(void *ptr)
+{
+	pcm_block *blk;
+	snd_pcm_sframes_t n, delay;
+
+	fprintf(stderr, "Starting Capture Thread\n");
+	while(!exit_program)
+	{
+		/* get an empty block - if none keep the capture running anyway */
+		if((blk = ring_get(&free_ring)) == NULL)
+		{
+			blk = &drop_blk;
+			pipeline_drops++;
+		}
+
 		/* get input & handle errors */
-		while((long)(inframes = snd_pcm_readi(capture_handle, rdbuf, frames)) < 0)
+		while((n = snd_pcm_readi(capture_handle, blk->buf, frames)) < 0)
 		{
-			if(inframes == -EAGAIN)
+			if(n == -EAGAIN)
 				continue;
-			
-			if((err = snd_pcm_recover(capture_handle, (int)inframes, 1)))
-				fprintf(stderr, "Input recover failed: %s\n",
-					snd_strerror(err));
+
+			pcm_recover(capture_handle, STATS_CAPTURE, (int)n);
 		}
-		
-		if(inframes != frames)
-			fprintf(stderr, "Short read from capture device: %lu != %lu\n",
-				inframes, frames);
+
+		if(n != frames)
+		{
+			stats.pcm[STATS_CAPTURE].shorts++;
+			fprintf(stderr, "Short read from capture device: %ld != %lu\n",
+				n, frames);
+		}
+
+		/*
+		 * for the latency measurement - when the input waiting now would
+		 * have been empty, so playback can work out the delay at its write
+		 */
+		if(snd_pcm_delay(capture_handle, &delay) == 0 && delay >= 0)
+			atomic_store_explicit(&pipeline_cap_zero, pipeline_now() -
+				(unsigned long long)delay * 1000000000ULL / sample_rate,
+				memory_order_relaxed);
+
+		/* pass it on */
+		blk->frames = n;
+		if(blk != &drop_blk)
+			ring_put(&cap_ring, blk);
+	}
+
+	fprintf(stderr, "Capture Thread Quitting.\n");
+	return NULL;
+}
+
+/*
+ * pipeline DSP thread
+ */
+void *dsp_thread_handler(void *ptr)
+{
+	pcm_block *blk;
+
+	fprintf(stderr, "Starting DSP Thread\n");
+	while(!exit_program)
+	{
+		if((blk = ring_wait(&cap_ring, 100)) == NULL)
+			continue;
 
 		/* now processes the frames */
-		Audio_Process(rdbuf, inframes);
+		Audio_Process(blk->buf, blk->frames);
+
+		ring_put(&play_ring, blk);
+	}
 
-		while((long)(outframes = snd_pcm_writei(playback_handle, rdbuf, inframes)) < 0)
+	fprintf(stderr, "DSP Thread Quitting.\n");
+	return NULL;
+}
+
+/*
+ * pipeline playback thread
+ */
+void *playback_thread_handler(void *ptr)
+{
+	pcm_block *blk;
+	snd_pcm_sframes_t n;
+
+	fprintf(stderr, "Starting Playback Thread\n");
+	while(!exit_program)
+	{
+		if((blk = ring_wait(&play_ring, 100)) == NULL)
+			continue;
+
+		while((n = snd_pcm_writei(playback_handle, blk->buf, blk->frames)) < 0)
 		{
-			if (outframes == -EAGAIN)
+			if (n == -EAGAIN)
 				continue;
-			
-			if((err = snd_pcm_recover(playback_handle, (int)outframes, 1)))
-				fprintf(stderr, "Output recover failed: %s\n",
-					snd_strerror(err));
+
+			pcm_recover(playback_handle, STATS_PLAYBACK, (int)n);
 		}
-		
-		if (outframes != inframes)
-			fprintf(stderr, "Short write to playback device: %lu != %lu\n",
-				outframes, frames);
+
+		if (n != blk->frames)
+		{
+			stats.pcm[STATS_PLAYBACK].shorts++;
+			fprintf(stderr, "Short write to playback device: %ld != %ld\n",
+				n, blk->frames);
+		}
+
+		/* capture delay as of now & everything still in the rings */
+		measure_latency((pipeline_now() - atomic_load_explicit(&pipeline_cap_zero,
+			memory_order_relaxed)) * sample_rate / 1000000000ULL,
+			blk->frames * (ring_depth(&cap_ring) + ring_depth(&play_ring)));
+
+		/* recycle */
+		ring_put(&free_ring, blk);
 	}
-	
-	fprintf(stderr, "Audio Thread Quitting.\n");
+
+	fprintf(stderr, "Playback Thread Quitting.\n");
 	return NULL;
 }
 
 /*
- * initialize the mixer
+ * allocate the block pool & rings, start the pipeline threads
  */
-void mixer_init(void)
+int pipeline_start(void)
 {
-	const char *card = "default";
-	const char *selem_name = "Master";
+	unsigned int i;
 
-	snd_mixer_open(&mixer_handle, 0);
-	snd_mixer_attach(mixer_handle, card);
-	snd_mixer_selem_register(mixer_handle, NULL, NULL);
-	snd_mixer_load(mixer_handle);
+	if(pipeline_blocks < 3)
+		pipeline_blocks = 3;
 
-	snd_mixer_selem_id_alloca(&sid);
-	snd_mixer_selem_id_set_index(sid, 0);
-	snd_mixer_selem_id_set_name(sid, selem_name);
-	elem = snd_mixer_find_selem(mixer_handle, sid);
+	/* rings big enough to hold every block so puts never fail */
+	if(ring_init(&free_ring, pipeline_blocks) ||
+		ring_init(&cap_ring, pipeline_blocks) ||
+		ring_init(&play_ring, pipeline_blocks))
+		return 1;
+
+	/* preallocate all the frame blocks */
+	blk_pool = (pcm_block *)calloc(pipeline_blocks, sizeof(pcm_block));
+	drop_blk.buf = (char *)malloc(buffer_size);
+	if(!blk_pool || !drop_blk.buf)
+		return 1;
+	for(i=0;i<pipeline_blocks;i++)
+	{
+		if((blk_pool[i].buf = (char *)malloc(buffer_size)) == NULL)
+			return 1;
+		if(mlock_mode)
+			rt_prefault(blk_pool[i].buf, buffer_size);
+		ring_put(&free_ring, &blk_pool[i]);
+	}
+	ring_reset_hwm(&free_ring);
+	atomic_store(&pipeline_cap_zero, pipeline_now());
+
+	if(rt_thread_create(&play_thread, playback_thread_handler, NULL, RT_PIN_AUDIO))
+		return 1;
+	if(rt_thread_create(&dsp_thread, dsp_thread_handler, NULL, RT_PIN_AUDIO))
+		return 1;
+	if(rt_thread_create(&cap_thread, capture_thread_handler, NULL, RT_PIN_AUDIO))
+		return 1;
+
+	return 0;
 }
 
 /*
- * set mixer main level
+ * report ring depth / high water marks
  */
-void mixer_set(long volume)
+void pipeline_report(FILE *f)
 {
-	long min, max;
+	fprintf(f, "free: %u/%u  cap: %u/%u  play: %u/%u  (depth/hwm)  drops: %lu\n",
+		ring_depth(&free_ring), ring_hwm(&free_ring),
+		ring_depth(&cap_ring), ring_hwm(&cap_ring),
+		ring_depth(&play_ring), ring_hwm(&play_ring),
+		pipeline_drops);
+}
 
-	snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
-	snd_mixer_selem_set_playback_volume_all(elem, volume * max / 100);	
+/*
+ * join the pipeline threads & release the blocks
+ */
+void pipeline_stop(void)
+{
+	unsigned int i;
+
+	pthread_join(cap_thread, NULL);
+	pthread_join(dsp_thread, NULL);
+	pthread_join(play_thread, NULL);
+	pipeline_report(stderr);
+
+	for(i=0;i<pipeline_blocks;i++)
+		free(blk_pool[i].buf);
+	free(blk_pool);
+	free(drop_blk.buf);
+	ring_free(&free_ring);
+	ring_free(&cap_ring);
+	ring_free(&play_ring);
 }
 
+/* long options */
+static const struct option long_opts[] =
+{
+	{"latency", required_argument, NULL, 'L'},
+	{"rt-prio", required_argument, NULL, 'R'},
+	{"cpu", required_argument, NULL, 'C'},
+	{"mlock", no_argument, NULL, 'M'},
+	{"poll", required_argument, NULL, 'p'},
+	{"cfg-speed", required_argument, NULL, 'S'},
+	{"help", no_argument, NULL, 'h'},
+	{"version", no_argument, NULL, 'V'},
+	{NULL, 0, NULL, 0}
+};
+
 /*
  * top level
  */
@@ -255,11 +814,14 @@ int main(int argc, char **argv)
 	struct sigaction sigIntHandler;
 	int i, verbose = 0;
 	int  iret;
-	uint32_t ID;
-	int rxchar;
+	struct pollfd stdin_pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+	int stdin_open = 1;
+	char inbuf[64];
+	ssize_t n;
 	
 	/* parse options */
-	while((opt = getopt(argc, argv, "b:d:f:r:vVh")) != EOF)
+	while((opt = getopt_long(argc, argv, "b:C:d:f:i:L:mMo:p:P:r:R:S:vVh", long_opts,
+		NULL)) != EOF)
 	{
 		switch(opt)
 		{
@@ -268,6 +830,17 @@ int main(int argc, char **argv)
 				buffer_size = atoi(optarg);
 				break;
 
+			case 'C':
+				/* audio thread core */
+				rt_cpu = atoi(optarg);
+				if(rt_cpu < 0 || rt_cpu >= sysconf(_SC_NPROCESSORS_ONLN))
+				{
+					fprintf(stderr, "No cpu %s - 0 to %ld online\n", optarg,
+						sysconf(_SC_NPROCESSORS_ONLN)-1);
+					exit(1);
+				}
+				break;
+
 			case 'd':
 				/* demod */
 				{
@@ -302,6 +875,52 @@ int main(int argc, char **argv)
 				filter = i<5 ? i : 4;
 				break;
 					
+			case 'i':
+				/* replay input file */
+				replay_in_name = optarg;
+				break;
+
+			case 'M':
+				/* lock & prefault memory */
+				mlock_mode = 1;
+				break;
+
+			case 'o':
+				/* replay output file */
+				replay_out_name = optarg;
+				break;
+
+			case 'L':
+				/* low latency - sets the period size */
+				latency_ms = atoi(optarg);
+				if(latency_ms < 1)
+				{
+					fprintf(stderr, "Latency must be at least 1 ms\n");
+					exit(1);
+				}
+				break;
+
+			case 'm':
+				/* zero-copy mmap I/O */
+				mmap_mode = 1;
+				break;
+
+			case 'p':
+				/* FPGA status poll rate */
+				rxadc_poll_hz = atoi(optarg);
+				if(rxadc_poll_hz < 0 || rxadc_poll_hz > RXADC_POLL_MAX)
+				{
+					fprintf(stderr, "Poll rate must be 0 - %d Hz\n",
+						RXADC_POLL_MAX);
+					exit(1);
+				}
+				break;
+
+			case 'P':
+				/* threaded pipeline block count */
+				pipeline_blocks = atoi(optarg);
+				break;
+
 			case 'r':
 				/* sample rate */
 				sample_rate = atoi(optarg);
@@ -317,6 +936,30 @@ int main(int argc, char **argv)
 				}
 				break;
 				
+			case 'R':
+				/* SCHED_FIFO priority */
+				rt_prio = atoi(optarg);
+				if(rt_prio < sched_get_priority_min(SCHED_FIFO) ||
+					rt_prio > sched_get_priority_max(SCHED_FIFO))
+				{
+					fprintf(stderr, "RT priority must be %d to %d\n",
+						sched_get_priority_min(SCHED_FIFO),
+						sched_get_priority_max(SCHED_FIFO));
+					exit(1);
+				}
+				break;
+
+			case 'S':
+				/* bitstream load SPI clock */
+				cfg_speed = strtoul(optarg, NULL, 0);
+				if(cfg_speed < 1000000 || cfg_speed > ICE_CFG_HZ_MAX)
+				{
+					fprintf(stderr, "Config speed must be 1 - %d MHz\n",
+						ICE_CFG_HZ_MAX/1000000);
+					exit(1);
+				}
+				break;
+
 			case 'v':
 				verbose = 1;
 				break;
@@ -332,7 +975,17 @@ int main(int argc, char **argv)
 				fprintf(stderr, "Options: -b <Buffer Size>    Default: %d\n", buffer_size);
 				fprintf(stderr, "         -d <demod>          Default: %s\n", audio_demod_names[demod]);
 				fprintf(stderr, "         -f <filter BW kHz>  Default: %d\n", Audio_GetFilterBW(filter));
+				fprintf(stderr, "         -i <I/Q file>       offline replay from WAV or raw S16\n");
+				fprintf(stderr, "         -L, --latency <ms>  low latency, smallest period to suit\n");
+				fprintf(stderr, "         -o <audio file>     replay output, .wav or raw S16\n");
+				fprintf(stderr, "         -m                  mmap (zero-copy) audio I/O\n");
+				fprintf(stderr, "         -M, --mlock         lock & prefault memory\n");
+				fprintf(stderr, "         -p, --poll <Hz>     FPGA status poll, 0 = off, Default: %d\n", rxadc_poll_hz);
+				fprintf(stderr, "         -P <blocks>         threaded pipeline, Default: off\n");
 				fprintf(stderr, "         -r <sample rate Hz> Default: %d\n", sample_rate);
+				fprintf(stderr, "         -R, --rt-prio <n>   SCHED_FIFO audio threads, Default: off\n");
+				fprintf(stderr, "         -C, --cpu <n>       pin audio threads to a core\n");
+				fprintf(stderr, "         -S, --cfg-speed <Hz> FPGA load clock, Default: %u\n", cfg_speed);
 				fprintf(stderr, "         -v enables verbose progress messages\n");
 				fprintf(stderr, "         -V prints the tool version\n");
 				fprintf(stderr, "         -h prints this help\n");
@@ -340,6 +993,29 @@ int main(int argc, char **argv)
 		}
 	}
 	
+	/* set up for control c */
+	sigIntHandler.sa_handler = handle_signals;
+	sigemptyset(&sigIntHandler.sa_mask);
+	sigIntHandler.sa_flags = 0;
+	sigaction(SIGINT, &sigIntHandler, NULL);
+
+	/*
+	 * low latency - the first frame of a period waits out that period in
+	 * capture then the rest of the playback buffer behind it, so split the
+	 * budget over fragments periods
+	 */
+	if(latency_ms)
+		buffer_size = (int)((long)latency_ms * sample_rate / 1000 /
+			fragments) * nchannels * (bits / 8);
+
+	/* offline replay doesn't touch any hardware */
+	if(replay_in_name)
+		exit(replay_run());
+	
+	/* keep the audio path out of swap & page faults */
+	if(mlock_mode)
+		rt_lock_memory();
+
 	/* open up hardware */
 	if((bs = ice_init(1, verbose)) == NULL)
 	{
@@ -347,39 +1023,21 @@ int main(int argc, char **argv)
 		exit(2);
 	}
 	
-	/* check if FPGA needs to be configured */
-	if(ice_read(bs, RXADC_REG_ID, &ID))
+	/* configure FPGA unless it's already running this bitstream */
+	if(rxadc_configure(bitstream_name, cfg_speed, verbose))
 	{
-		fprintf(stderr, "Error reading ID\n");
 		ice_delete(bs);
 		exit(1);
-	}		
+	}
 	
-	if((ID & 0xFFFFFF00) != 0xADC50000)
+	/* load the register shadow & start the status poller */
+	if(rxadc_init())
 	{
-        /* Configure FPGA */
-        if(verbose == 1)
-		{
-			fprintf(stderr, "ID mismatch - Expected 0x%06X, got 0x%06X\n", 0xADC500, ID>>8);
-			fprintf(stderr, "Configuring FPGA\n");
-		}
-		
-        if(ice_cfg(bs, bitstream_name))
-        {
-            fprintf(stderr, "Error sending bitstream to FPGA\n");
-			ice_delete(bs);
-			exit(1);
-        }
-		
-		/* Update ID */
-		if(ice_read(bs, RXADC_REG_ID, &ID))
-		{
-			fprintf(stderr, "Error reading ID\n");
-			ice_delete(bs);
-			exit(1);
-		}
+		ice_delete(bs);
+		exit(1);
 	}
-	
+	rxadc_poll(rxadc_poll_hz);
+
 	/* set DAC mux */
 	rxadc_set_dacmux(RXADC_ENABLE);
 	
@@ -420,72 +1078,84 @@ int main(int argc, char **argv)
 			fprintf(stderr, "Si5351 configured for 0:50MHz, 1:25MHz\n");
 	}
 	
-	/* set up for control c */
-	sigIntHandler.sa_handler = handle_signals;
-	sigemptyset(&sigIntHandler.sa_mask);
-	sigIntHandler.sa_flags = 0;
-	sigaction(SIGINT, &sigIntHandler, NULL);
-
-	/* open input and output devices */
-	if((err = snd_pcm_open(&capture_handle, snd_device_in, SND_PCM_STREAM_CAPTURE, 0)) < 0)
+	/* open the audio devices */
+	backend = &alsa_backend;
+	if(backend->open())
 	{
-		fprintf(stderr, "cannot open input audio device %s: %s\n", snd_device_out, snd_strerror(err));
+		shared_i2c_free();
 		ice_delete(bs);
 		exit(1);
 	}
 
-	if((err = snd_pcm_open(&playback_handle, snd_device_out, SND_PCM_STREAM_PLAYBACK, 0)) < 0)
-	{
-		fprintf(stderr, "cannot open input audio device %s: %s\n", snd_device_in, snd_strerror(err));
-		snd_pcm_close(capture_handle);
-		ice_delete(bs);
-		exit(1);
-	}
-	
-	/* set up both devices identically */
-	configure_alsa_audio(capture_handle,  nchannels);
-	configure_alsa_audio(playback_handle, nchannels);
-	
-	/* init the mixer */
-	mixer_init();
-	mixer_set(play_vol);
-
 	/* set up sizes */
 	frame_size = nchannels * (bits / 8);
 	fprintf(stderr, "Bytes/Frame = %d\n", frame_size);
 	frames = buffer_size / frame_size;
 	fprintf(stderr, "Frames/buffer = %lu\n", frames);
 	
+	if(latency_ms)
+		fprintf(stderr, "Latency: %u x %lu frame periods, about %.1f ms\n",
+			fragments, frames,
+			fragments * frames * 1000.0 / sample_rate);
+
 	/* allocate the audio buffer */
 	rdbuf = (char *)malloc(buffer_size);
+	if(mlock_mode)
+		rt_prefault(rdbuf, buffer_size);
 		
 	/* prepare for use */
 	snd_pcm_prepare(capture_handle);
 	snd_pcm_prepare(playback_handle);
 
-	/* fill the whole output buffer */
+	/* fill the whole output buffer with silence */
+	memset(rdbuf, 0, buffer_size);
 	for(i = 0; i < fragments; i += 1)
-		snd_pcm_writei(playback_handle, rdbuf, frames);
+	{
+		if(mmap_mode)
+			snd_pcm_mmap_writei(playback_handle, rdbuf, frames);
+		else
+			snd_pcm_writei(playback_handle, rdbuf, frames);
+	}
 	
 	/* set up audio processing */
 	Audio_Init();
 	Audio_SetDemod(demod);
 	Audio_SetFilter(filter);
 	fprintf(stderr, "Demod: %s, Filter: %d Hz\n", audio_demod_names[demod], Audio_GetFilterBW(filter));
+	if(mlock_mode)
+		Audio_Prefault();
 	
-	/* start audio thread */
-	fprintf(stderr, "main: starting audio thread...\n");
-	iret = pthread_create(&audio_thread, NULL, audio_thread_handler, NULL);
+	/* start audio thread(s) */
+	if(mmap_mode)
+	{
+		fprintf(stderr, "main: starting mmap audio thread...\n");
+		iret = rt_thread_create(&audio_thread, mmap_thread_handler, NULL, RT_PIN_AUDIO);
+	}
+	else if(pipeline_blocks)
+	{
+		fprintf(stderr, "main: starting audio pipeline, %u blocks...\n",
+			pipeline_blocks);
+		iret = pipeline_start();
+	}
+	else
+	{
+		fprintf(stderr, "main: starting audio thread...\n");
+		iret = rt_thread_create(&audio_thread, audio_thread_handler, NULL, RT_PIN_AUDIO);
+	}
 	if(!iret)
 	{	
+		rt_report();
+
+		/* hardware commands run off the control loop */
+		if(hwq_start())
+			fprintf(stderr, "main: hardware commands will run inline\n");
+		
 		/* wait for ^C */
 		fprintf(stderr, "Starting Command Process Loop\n");
 		init_cmd();
 		while(!exit_program)
 		{
-			/* wait a bit */
-			usleep(20000);
-			
+
 #if 0
 			/* status */
 			fprintf(stderr, "RSSI: %d dBm  ", Audio_GetRSSI());
@@ -493,31 +1163,43 @@ int main(int argc, char **argv)
 				fprintf(stderr, "Sync State: %s Sync Frq: %d     ",
 					audio_sync_names[Audio_GetSyncSt()], Audio_GetSyncFrq());
 			fprintf(stderr, "\r");
+			/* wait a bit */
+			usleep(20000);
 #else
-			/* cmd handler */
-			if((rxchar = getchar())!= EOF)
+			/* wait a bit for input - never blocks on a partial line */
+			if(poll(&stdin_pfd, stdin_open, 20) > 0)
 			{
+				if((n = read(STDIN_FILENO, inbuf, sizeof(inbuf))) <= 0)
+					stdin_open = 0;
+				
 				/* Parse commands */
-				cmd_parse(rxchar);
+				for(i=0;i<n;i++)
+					cmd_parse(inbuf[i]);
 			}
+			
+			/* report finished hardware commands & scan hits */
+			cmd_poll();
 #endif
 		}
 		fprintf(stderr, "main: finishing...\n");
+		scan_stop();
+		sweep_stop();
+		hwq_stop();
 		
-		pthread_join(audio_thread, NULL);
+		if(pipeline_blocks)
+			pipeline_stop();
+		else
+			pthread_join(audio_thread, NULL);
 		fprintf(stderr, "main: audio thread joined...\n");
 	}
 	else
 		fprintf(stderr, "main: error creating audio thread\n");
 	
 	/* clean up */
-	snd_pcm_drain(playback_handle);
-	snd_pcm_drop(capture_handle);
+	backend->close();
 	free(rdbuf);
-	snd_mixer_close(mixer_handle);
-	snd_pcm_close(playback_handle);
-	snd_pcm_close(capture_handle);
 	shared_i2c_free();
+	rxadc_poll(0);
 	ice_delete(bs);
 
 	return 0;
@@ -6,6 +6,7 @@
 #ifndef __main__
 #define __main__
 
+#include <stdio.h>
 #include <stdint.h>
 #include <math.h>
 #include "ice_lib.h"
@@ -15,8 +16,10 @@ typedef float float32_t;
 
 extern int sample_rate;
 extern int exit_program;
+extern int vhf;
 extern iceblk *bs;
 extern long play_vol;
 void mixer_set(long vol);
+void pipeline_report(FILE *f);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+/*
+ * pfb.c - polyphase filter bank channelizer
+ * 10-16-26 E. Brombaugh
+ *
+ * Splits the complex baseband into M channels spaced fs/M apart, each
+ * decimated by M. Every M input samples the M polyphase branches of a
+ * windowed-sinc prototype are summed and one M point FFT turns them
+ * into the M channel outputs, so the cost is PFB_TAPS + log2(M) per
+ * input sample. Each channel gets a light AM or NBFM detector and the
+ * selected channel is interpolated back up to the audio rate with the
+ * same prototype.
+ *
+ * Channel count changes are requested by the command thread and picked
+ * up by the audio thread at the start of the next buffer. The FFT tables
+ * are sized for PFB_MAX_M up front and rebuilt in place, so nothing is
+ * allocated or freed on the audio thread. Settings the command thread
+ * changes while the channelizer runs are atomic.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "main.h"
+#include "audio_blk.h"
+#include "fft.h"
+#include "pfb.h"
+
+/* channel detector rates at fs/M */
+#define PFB_DC_ALPHA 0.005F
+#define PFB_PWR_ALPHA 0.05F
+#define PFB_FM_SCALE (0.5F/PI)
+
+/* per channel detector */
+typedef struct
+{
+	uint8_t demod;
+	float32_t dc, pwr;			/* AM carrier & power estimates */
+	float32_t pi, pq;			/* previous sample for NBFM */
+	float32_t audio;			/* latest detector output */
+} pfb_chan;
+
+const char *pfb_demod_names[PFB_DEMOD_MAX] =
+{
+	"AM",
+	"NBFM",
+};
+
+/* configuration */
+atomic_int pfb_req_m, pfb_sel;
+int pfb_m;
+_Atomic float32_t pfb_sq = 1e-7F;	/* squelch power, -70dBFS */
+fft_plan pfb_fft;
+float32_t pfb_fft_cs[PFB_MAX_M/2], pfb_fft_sn[PFB_MAX_M/2];
+uint16_t pfb_fft_rev[PFB_MAX_M];
+
+/* prototype lowpass, M*PFB_TAPS long */
+float32_t pfb_h[PFB_MAX_M*PFB_TAPS];
+
+/* input history, newest first & doubled so any window is contiguous */
+float32_t pfb_hist_i[2*PFB_MAX_M*PFB_TAPS], pfb_hist_q[2*PFB_MAX_M*PFB_TAPS];
+int pfb_pos, pfb_phase;
+
+/* branch sums -> channel outputs */
+float32_t pfb_vi[PFB_MAX_M] BLK_ALIGN, pfb_vq[PFB_MAX_M] BLK_ALIGN;
+pfb_chan pfb_ch[PFB_MAX_M];
+
+/* selected channel audio history for the interpolator */
+float32_t pfb_y[2*PFB_TAPS];
+int pfb_ypos;
+
+/* block scratch */
+float32_t pfb_in_i[AUDIO_BLKSZ] BLK_ALIGN, pfb_in_q[AUDIO_BLKSZ] BLK_ALIGN;
+float32_t pfb_out[AUDIO_BLKSZ] BLK_ALIGN;
+
+/*
+ * off at startup
+ */
+void pfb_init(void)
+{
+	atomic_store(&pfb_req_m, 0);
+	atomic_store(&pfb_sel, 0);
+	pfb_m = 0;
+}
+
+/*
+ * request M channels, 0 = off. Applied by the audio thread.
+ */
+void pfb_set_channels(int m)
+{
+	if(m < 2 || m > PFB_MAX_M || (m & (m-1)))
+		m = 0;
+	atomic_store(&pfb_req_m, m);
+}
+
+int pfb_get_channels(void)
+{
+	return atomic_load(&pfb_req_m);
+}
+
+/*
+ * choose the channel sent to the output
+ */
+void pfb_select(int c)
+{
+	if(c >= 0 && c < PFB_MAX_M)
+		atomic_store(&pfb_sel, c);
+}
+
+int pfb_get_select(void)
+{
+	return atomic_load(&pfb_sel);
+}
+
+/*
+ * squelch level for the selected channel
+ */
+void pfb_set_squelch(int16_t db)
+{
+	atomic_store(&pfb_sq, powf(10.0F, (float32_t)db/10.0F));
+}
+
+int16_t pfb_get_squelch(void)
+{
+	return (int16_t)floorf(10.0F*log10f(atomic_load(&pfb_sq)) + 0.5F);
+}
+
+/*
+ * per channel detector
+ */
+void pfb_set_demod(int c, uint8_t demod)
+{
+	if(c >= 0 && c < PFB_MAX_M)
+		pfb_ch[c].demod = demod % PFB_DEMOD_MAX;
+}
+
+uint8_t pfb_get_demod(int c)
+{
+	return (c >= 0 && c < PFB_MAX_M) ? pfb_ch[c].demod : 0;
+}
+
+/*
+ * channel center relative to the LO
+ */
+int32_t pfb_chan_freq(int c)
+{
+	float32_t actual_sr = sample_rate * 12.5F / 12.0F;
+	int m = atomic_load(&pfb_req_m);
+
+	if(!m)
+		return 0;
+	if(c >= m/2)
+		c -= m;
+	return (int32_t)(c * actual_sr / m);
+}
+
+/*
+ * channel power in dB full scale
+ */
+int16_t pfb_chan_rssi(int c)
+{
+	float32_t p;
+
+	if(c < 0 || c >= PFB_MAX_M)
+		return -200;
+	p = pfb_ch[c].pwr;
+	return p > 1e-20F ? (int16_t)(10.0F*log10f(p)) : -200;
+}
+
+/*
+ * build the prototype & clear the history for m channels - audio thread,
+ * everything is rebuilt in the preallocated tables
+ */
+static int pfb_configure(int m)
+{
+	int j, l = m*PFB_TAPS;
+	float32_t x, sum = 0.0F, ctr = (l-1)/2.0F;
+
+	pfb_m = 0;
+	if(!m)
+		return 0;
+	if(fft_init_static(&pfb_fft, m, pfb_fft_cs, pfb_fft_sn, pfb_fft_rev))
+	{
+		fprintf(stderr, "pfb_configure: FFT init failed for %d channels\n", m);
+		atomic_store(&pfb_req_m, 0);
+		return 1;
+	}
+
+	/* Blackman windowed sinc, cutoff at half the channel spacing */
+	for(j=0;j<l;j++)
+	{
+		x = ((float32_t)j - ctr) / (float32_t)m;
+		pfb_h[j] = x == 0.0F ? 1.0F : sinf(PI*x)/(PI*x);
+		pfb_h[j] *= 0.42F - 0.5F*cosf(2.0F*PI*j/(l-1)) +
+			0.08F*cosf(4.0F*PI*j/(l-1));
+		sum += pfb_h[j];
+	}
+
+	/* unity gain at DC */
+	for(j=0;j<l;j++)
+		pfb_h[j] /= sum;
+
+	memset(pfb_hist_i, 0, sizeof(pfb_hist_i));
+	memset(pfb_hist_q, 0, sizeof(pfb_hist_q));
+	memset(pfb_y, 0, sizeof(pfb_y));
+	for(j=0;j<PFB_MAX_M;j++)
+	{
+		pfb_ch[j].dc = pfb_ch[j].pwr = 0.0F;
+		pfb_ch[j].pi = pfb_ch[j].pq = 0.0F;
+		pfb_ch[j].audio = 0.0F;
+	}
+	pfb_pos = pfb_phase = pfb_ypos = 0;
+	pfb_m = m;
+
+	return 0;
+}
+
+/*
+ * M new inputs are in - compute all channels & detect
+ */
+static void pfb_block(void)
+{
+	const float32_t *wi = &pfb_hist_i[pfb_pos], *wq = &pfb_hist_q[pfb_pos];
+	float32_t si, sq, mag, re, im;
+	pfb_chan *ch;
+	int k, p, j, m = pfb_m;
+	int sel = atomic_load_explicit(&pfb_sel, memory_order_relaxed);
+	float32_t sql = atomic_load_explicit(&pfb_sq, memory_order_relaxed);
+
+	/* polyphase branch sums */
+	for(k=0;k<m;k++)
+	{
+		si = sq = 0.0F;
+		for(p=0,j=k;p<PFB_TAPS;p++,j+=m)
+		{
+			si += pfb_h[j] * wi[j];
+			sq += pfb_h[j] * wq[j];
+		}
+		pfb_vi[k] = si;
+		pfb_vq[k] = sq;
+	}
+
+	/* e^+j rotation puts channel c at +c*fs/M */
+	fft_run(&pfb_fft, pfb_vi, pfb_vq, 1);
+
+	/* detectors - all kept running so switching channels is clean */
+	for(k=0;k<m;k++)
+	{
+		ch = &pfb_ch[k];
+		mag = pfb_vi[k]*pfb_vi[k] + pfb_vq[k]*pfb_vq[k];
+		ch->pwr += PFB_PWR_ALPHA * (mag - ch->pwr);
+
+		if(ch->demod == PFB_NBFM)
+		{
+			/* phase step from the conjugate product */
+			re = pfb_vi[k]*ch->pi + pfb_vq[k]*ch->pq;
+			im = pfb_vq[k]*ch->pi - pfb_vi[k]*ch->pq;
+			ch->pi = pfb_vi[k];
+			ch->pq = pfb_vq[k];
+			ch->audio = atan2f(im, re) * PFB_FM_SCALE;
+		}
+		else
+		{
+			/* envelope as modulation depth */
+			mag = sqrtf(mag);
+			ch->dc += PFB_DC_ALPHA * (mag - ch->dc);
+			ch->audio = 0.5F * (mag - ch->dc) / (ch->dc + 1e-6F);
+		}
+	}
+
+	/* push selected audio if above squelch, newest first */
+	pfb_ypos = pfb_ypos ? pfb_ypos-1 : PFB_TAPS-1;
+	pfb_y[pfb_ypos] = pfb_y[pfb_ypos+PFB_TAPS] =
+		(sel < m && pfb_ch[sel].pwr > sql) ? pfb_ch[sel].audio : 0.0F;
+}
+
+/*
+ * channelize a buffer - returns 0 if the channelizer is off
+ */
+int pfb_process(int16_t *src, int16_t *dst, int frames)
+{
+	int k, j, p, n, m, l;
+	float32_t u;
+	const float32_t *h, *y;
+
+	/* pick up reconfiguration */
+	if((m = atomic_load_explicit(&pfb_req_m, memory_order_relaxed)) != pfb_m)
+		pfb_configure(m);
+	if(!(m = pfb_m))
+		return 0;
+	l = m*PFB_TAPS;
+
+	for(k=0;k<frames;k+=n)
+	{
+		n = frames-k > AUDIO_BLKSZ ? AUDIO_BLKSZ : frames-k;
+		blk_s16_to_iq(&src[2*k], pfb_in_i, pfb_in_q, n);
+
+		for(j=0;j<n;j++)
+		{
+			/* newest input at the front of the window */
+			pfb_pos = pfb_pos ? pfb_pos-1 : l-1;
+			pfb_hist_i[pfb_pos] = pfb_hist_i[pfb_pos+l] = pfb_in_i[j];
+			pfb_hist_q[pfb_pos] = pfb_hist_q[pfb_pos+l] = pfb_in_q[j];
+
+			/* interpolator output for this phase */
+			h = &pfb_h[pfb_phase];
+			y = &pfb_y[pfb_ypos];
+			u = 0.0F;
+			for(p=0;p<PFB_TAPS;p++)
+				u += h[p*m] * y[p];
+			pfb_out[j] = u * m;
+
+			if(++pfb_phase == m)
+			{
+				pfb_phase = 0;
+				pfb_block();
+			}
+		}
+
+		blk_iq_to_s16(&dst[2*k], pfb_out, pfb_out, n);
+	}
+
+	return 1;
+}
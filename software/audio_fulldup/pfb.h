@@ -0,0 +1,39 @@
+/*
+ * pfb.h - polyphase filter bank channelizer
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __pfb__
+#define __pfb__
+
+#include "main.h"
+
+/* max subchannels - power of 2 */
+#define PFB_MAX_M 64
+
+/* prototype filter taps per polyphase branch */
+#define PFB_TAPS 8
+
+enum pfb_demods
+{
+	PFB_AM,
+	PFB_NBFM,
+	PFB_DEMOD_MAX
+};
+
+extern const char *pfb_demod_names[PFB_DEMOD_MAX];
+
+void pfb_init(void);
+void pfb_set_channels(int m);
+int pfb_get_channels(void);
+void pfb_select(int c);
+int pfb_get_select(void);
+void pfb_set_squelch(int16_t db);
+int16_t pfb_get_squelch(void);
+void pfb_set_demod(int c, uint8_t demod);
+uint8_t pfb_get_demod(int c);
+int32_t pfb_chan_freq(int c);
+int16_t pfb_chan_rssi(int c);
+int pfb_process(int16_t *src, int16_t *dst, int frames);
+
+#endif
@@ -10,8 +10,8 @@
 #include <errno.h>
 #include <ctype.h>
 #include <sys/ioctl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
-#include <i2c/smbus.h>
 #include "r820t2.h"
 #include "shared_i2c.h"
 
@@ -31,6 +31,10 @@
 #define R820T2_NUM_REGS     0x20
 #define R820T2_WRITE_START	5
 
+/* unchanged regs a flush will resend to join two dirty ranges - cheaper
+   than the address, register & restart of another message */
+#define R820T2_FLUSH_GAP	2
+
 /* initial values from airspy */
 /* initial freq @ 128MHz -> ~5MHz IF due to xtal mismatch */
 static const uint8_t r82xx_init_array[R820T2_NUM_REGS] =
@@ -200,44 +204,145 @@ uint32_t r820t_xtal_freq;
 uint32_t r820t_if_freq;
 
 /*
- * Write single R820T2 reg via I2C
+ * write-back state - r820t_regs[] is what we want, r820t_hw[] what the
+ * chip is known to hold. A reg is dirty if they differ or it's unknown.
  */
-void R820T2_i2c_write_reg(uint8_t reg, uint8_t data)
+static uint8_t r820t_hw[R820T2_NUM_REGS];
+static uint32_t r820t_hw_valid;
+static int r820t_single_msg;
+
+#define R820T2_DIRTY(reg) (!(r820t_hw_valid & (1UL << (reg))) || \
+	r820t_regs[reg] != r820t_hw[reg])
+
+/*
+ * tuning plan cache - hashed on the quantized frequency with the least
+ * recently used plan replaced when full. Plans depend on the xtal & IF
+ * so the cache empties itself if either changes.
+ */
+#define R820T2_PLAN_HASH (2*R820T2_PLAN_CACHE)
+
+typedef struct
+{
+	r820t_plan plan;		/* plan.freq is the key */
+	int16_t newer, older;	/* LRU list */
+	int16_t chain;			/* next in hash bucket */
+} r820t_plan_ent;
+
+static r820t_plan_ent r820t_pc[R820T2_PLAN_CACHE];
+static int16_t r820t_pc_hash[R820T2_PLAN_HASH];
+static int16_t r820t_pc_newest = -1, r820t_pc_oldest = -1;
+static int r820t_pc_num = -1;
+static uint32_t r820t_pc_xtal, r820t_pc_if;
+uint32_t r820t_plan_step = R820T2_PLAN_STEP;
+unsigned long r820t_plan_hits, r820t_plan_misses;
+
+/*
+ * Set R820T2 reg in the cache - goes out on the next flush
+ */
+static void R820T2_reg_set(uint8_t reg, uint8_t data)
 {
     /* check for legal reg */
     if(reg>=R820T2_NUM_REGS)
         return;
     
-    /* update cache */
     r820t_regs[reg] = data;
-    
-	/* assign address of R820T2 */
-	if(ioctl(i2c_file, I2C_SLAVE, R820T2_I2C_ADDRESS) < 0)
-		return;
-	
-    /* send via I2C */
-	i2c_smbus_write_byte_data(i2c_file, reg, r820t_regs[reg]);
 }
 
 /*
- * Write single R820T2 reg via I2C with mask vs cached
+ * Set R820T2 reg bits in the cache with mask vs cached
  */
-void R820T2_i2c_write_cache_mask(uint8_t reg, uint8_t data, uint8_t mask)
+static void R820T2_reg_set_mask(uint8_t reg, uint8_t data, uint8_t mask)
 {
     /* check for legal reg */
     if(reg>=R820T2_NUM_REGS)
         return;
     
     /* mask vs cached reg */
-    data = (data & mask) | (r820t_regs[reg] & ~mask);
-    r820t_regs[reg] = data;
-    
-	/* assign address of R820T2 */
-	if(ioctl(i2c_file, I2C_SLAVE, R820T2_I2C_ADDRESS) < 0)
-		return;
-	
-    /* send via I2C */
-	i2c_smbus_write_byte_data(i2c_file, reg, r820t_regs[reg]);
+    r820t_regs[reg] = (data & mask) | (r820t_regs[reg] & ~mask);
+}
+
+/*
+ * Write all dirty R820T2 regs - one message per contiguous range, all
+ * in one I2C_RDWR transaction. Returns nonzero on bus error.
+ */
+uint8_t R820T2_i2c_flush(void)
+{
+	struct i2c_msg msgs[R820T2_NUM_REGS/2];
+	struct i2c_rdwr_ioctl_data xfer;
+	uint8_t buf[2*R820T2_NUM_REGS];
+	int reg, end, gap, n = 0, pos = 0, i;
+
+	/* collect dirty ranges */
+	for(reg=R820T2_WRITE_START;reg<R820T2_NUM_REGS;reg=end)
+	{
+		if(!R820T2_DIRTY(reg))
+		{
+			end = reg + 1;
+			continue;
+		}
+
+		/* grow over dirty regs & short clean gaps before more dirty ones */
+		end = reg + 1;
+		while(end < R820T2_NUM_REGS)
+		{
+			for(gap=0;gap<=R820T2_FLUSH_GAP && end+gap<R820T2_NUM_REGS;gap++)
+				if(R820T2_DIRTY(end+gap))
+					break;
+			if(gap > R820T2_FLUSH_GAP || end+gap >= R820T2_NUM_REGS)
+				break;
+			end += gap + 1;
+		}
+
+		/* register address then data, chip auto-increments */
+		msgs[n].addr = R820T2_I2C_ADDRESS;
+		msgs[n].flags = 0;
+		msgs[n].len = end - reg + 1;
+		msgs[n].buf = &buf[pos];
+		buf[pos++] = reg;
+		for(i=reg;i<end;i++)
+			buf[pos++] = r820t_regs[i];
+		n++;
+	}
+	if(!n)
+		return 0;
+
+	/* send combined, or a message at a time if the adapter can't */
+	xfer.msgs = msgs;
+	xfer.nmsgs = n;
+	if(r820t_single_msg || ioctl(i2c_file, I2C_RDWR, &xfer) < 0)
+	{
+		r820t_single_msg = 1;
+		xfer.nmsgs = 1;
+		for(i=0;i<n;i++)
+		{
+			xfer.msgs = &msgs[i];
+			if(ioctl(i2c_file, I2C_RDWR, &xfer) < 0)
+			{
+				/* no telling what got there - resend all next time */
+				r820t_hw_valid = 0;
+				return 1;
+			}
+		}
+	}
+
+	/* chip matches the cache now */
+	for(i=0;i<n;i++)
+		for(reg=msgs[i].buf[0];reg<msgs[i].buf[0]+msgs[i].len-1;reg++)
+		{
+			r820t_hw[reg] = r820t_regs[reg];
+			r820t_hw_valid |= 1UL << reg;
+		}
+
+	return 0;
+}
+
+/*
+ * Write single R820T2 reg via I2C
+ */
+void R820T2_i2c_write_reg(uint8_t reg, uint8_t data)
+{
+    R820T2_reg_set(reg, data);
+    R820T2_i2c_flush();
 }
 
 /*
@@ -251,35 +356,36 @@ const uint8_t bitrev_lut[16] = { 0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
  */
 uint8_t R820T2_i2c_read_raw(uint8_t *data, uint8_t sz)
 {
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data xfer;
 	uint8_t i, value;
-	ssize_t rsz;
 	
 	/* check for legal reg */
 	if(sz>R820T2_NUM_REGS)
 		return 1;
     
-	/* assign address of R820T2 */
-	if(ioctl(i2c_file, I2C_SLAVE, R820T2_I2C_ADDRESS) < 0)
-		return 1;
-	
-	/* do the bus transaction */
-	rsz = read(i2c_file, data, sz);
-	
-	if(rsz == -1)
+	/* do the bus transaction - reads always start at reg 0 */
+	msg.addr = R820T2_I2C_ADDRESS;
+	msg.flags = I2C_M_RD;
+	msg.len = sz;
+	msg.buf = data;
+	xfer.msgs = &msg;
+	xfer.nmsgs = 1;
+	if(ioctl(i2c_file, I2C_RDWR, &xfer) < 0)
 	{
 		printf("R820T2_i2c_read_raw: error %d\n", errno);
 		return 1;
 	}
 	
 	/* bit reverse all results */
-	for(i=0;i<rsz;i++)
+	for(i=0;i<sz;i++)
 	{
 		value = data[i];
         data[i] = (bitrev_lut[value & 0xf] << 4) | bitrev_lut[value >> 4];
 	}
 	
     /* status */
-    return (rsz != sz);
+    return 0;
 }
 
 /*
@@ -287,16 +393,15 @@ uint8_t R820T2_i2c_read_raw(uint8_t *data, uint8_t sz)
  */
 uint8_t R820T2_i2c_read_reg_uncached(uint8_t reg)
 {
-    uint8_t sz = reg+1;
+    uint8_t sz = reg+1, i;
     uint8_t *data = r820t_regs;
 	
     /* check for legal read */
 	if(sz>R820T2_NUM_REGS)
 		return 0;
     
-	/* assign address of R820T2 */
-	if(ioctl(i2c_file, I2C_SLAVE, R820T2_I2C_ADDRESS) < 0)
-		return 0;
+	/* pending writes go first, the read lands in the cache */
+	R820T2_i2c_flush();
 	
     /* get all regs up to & including desired reg */
     if(R820T2_i2c_read_raw(data, sz))
@@ -305,6 +410,13 @@ uint8_t R820T2_i2c_read_reg_uncached(uint8_t reg)
 		return 0;
 	}
 	
+	/* that's what the chip holds */
+	for(i=0;i<sz;i++)
+	{
+		r820t_hw[i] = r820t_regs[i];
+		r820t_hw_valid |= 1UL << i;
+	}
+	
     /* return desired */
     return r820t_regs[reg];
 }
@@ -329,6 +441,41 @@ uint8_t R820T2_i2c_read_reg_cached(uint8_t reg)
 int r820t_set_mux_freq_idx = -1; /* Default set to invalid value in order to force set_mux */
 #endif
 
+/*
+ * add a masked register update to a plan, merging with one already there
+ */
+static void R820T2_plan_add(r820t_plan *p, uint8_t reg, uint8_t data,
+	uint8_t mask)
+{
+    int i;
+    
+    for(i=0;i<p->n;i++)
+        if(p->reg[i] == reg)
+            break;
+    if(i == p->n)
+    {
+        if(p->n >= R820T2_PLAN_MAX)
+            return;
+        p->reg[i] = reg;
+        p->val[i] = 0;
+        p->mask[i] = 0;
+        p->n++;
+    }
+    p->val[i] = (p->val[i] & ~mask) | (data & mask);
+    p->mask[i] |= mask;
+}
+
+/*
+ * put a plan's register updates in the cache - goes out on the next flush
+ */
+static void R820T2_plan_load(const r820t_plan *p)
+{
+    int i;
+    
+    for(i=0;i<p->n;i++)
+        R820T2_reg_set_mask(p->reg[i], p->val[i], p->mask[i]);
+}
+
 /*
  * Update Tracking Filter
  * Kanged & Modified from airspy firmware
@@ -337,7 +484,7 @@ int r820t_set_mux_freq_idx = -1; /* Default set to invalid value in order to for
  * https://stuff.mit.edu/afs/sipb/contrib/linux/drivers/media/tuners/r820t.c
  * part of r820t_set_mux() (set tracking filter)
  */
-static void R820T2_set_tf(uint32_t freq)
+static void R820T2_plan_tf(r820t_plan *p, uint32_t freq)
 {
     const struct r820t_freq_range *range;
     unsigned int i;
@@ -354,26 +501,26 @@ static void R820T2_set_tf(uint32_t freq)
     range = &freq_ranges[i];
 
     /* Open Drain */
-    R820T2_i2c_write_cache_mask(0x17, range->open_d, 0x08);
+    R820T2_plan_add(p, 0x17, range->open_d, 0x08);
 
     /* RF_MUX,Polymux */
-    R820T2_i2c_write_cache_mask(0x1a, range->rf_mux_ploy, 0xc3);
+    R820T2_plan_add(p, 0x1a, range->rf_mux_ploy, 0xc3);
 
     /* TF BAND */
-    R820T2_i2c_write_reg(0x1b, range->tf_c);
+    R820T2_plan_add(p, 0x1b, range->tf_c, 0xff);
 
     /* XTAL CAP & Drive */
-    R820T2_i2c_write_cache_mask(0x10, 0x08, 0x0b);
+    R820T2_plan_add(p, 0x10, 0x08, 0x0b);
 
-    R820T2_i2c_write_cache_mask(0x08, 0x00, 0x3f);
+    R820T2_plan_add(p, 0x08, 0x00, 0x3f);
  
-    R820T2_i2c_write_cache_mask(0x09, 0x00, 0x3f);
+    R820T2_plan_add(p, 0x09, 0x00, 0x3f);
 }
 
 /*
- * Update LO PLL
+ * LO PLL plan
  */
-void R820T2_set_pll(uint32_t freq)
+static void R820T2_plan_pll(r820t_plan *p, uint32_t freq)
 {
     const uint32_t vco_min = 1770000000UL;
     const uint32_t vco_max = 3900000000UL;
@@ -410,16 +557,16 @@ void R820T2_set_pll(uint32_t freq)
     si = nint - (ni << 2);
 
     /* Set the vco output divider */
-    R820T2_i2c_write_cache_mask(0x10, (uint8_t) (div_num << 5), 0xe0);
+    R820T2_plan_add(p, 0x10, (uint8_t) (div_num << 5), 0xe0);
 
     /* Set the PLL Feedback integer divider */
-    R820T2_i2c_write_reg(0x14, (uint8_t) (ni + (si << 6)));
+    R820T2_plan_add(p, 0x14, (uint8_t) (ni + (si << 6)), 0xff);
 
     /* Update Fractional PLL */
     if (vco_frac == 0)
     {
         /* Disable frac pll */
-        R820T2_i2c_write_cache_mask(0x12, 0x08, 0x08);
+        R820T2_plan_add(p, 0x12, 0x08, 0x08);
     }
     else
     {
@@ -448,14 +595,26 @@ void R820T2_set_pll(uint32_t freq)
         */
         
         /* Update Sigma-Delta Modulator */
-        R820T2_i2c_write_reg(0x15, (uint8_t)(sdm & 0xff));
-        R820T2_i2c_write_reg(0x16, (uint8_t)(sdm >> 8));
+        R820T2_plan_add(p, 0x15, (uint8_t)(sdm & 0xff), 0xff);
+        R820T2_plan_add(p, 0x16, (uint8_t)(sdm >> 8), 0xff);
 
         /* Enable frac pll */
-        R820T2_i2c_write_cache_mask(0x12, 0x00, 0x08);
+        R820T2_plan_add(p, 0x12, 0x00, 0x08);
     }
 }
 
+/*
+ * Update LO PLL
+ */
+void R820T2_set_pll(uint32_t freq)
+{
+    r820t_plan p;
+    
+    p.n = 0;
+    R820T2_plan_pll(&p, freq);
+    R820T2_plan_load(&p);
+}
+
 /*
  * Correct for known PPM error
  */
@@ -468,9 +627,9 @@ uint32_t R820T2_correct_freq(uint32_t freq)
 }
 
 /*
- * Update Tracking Filter and LO to frequency
+ * work out the register updates for a frequency without touching the chip
  */
-void R820T2_set_freq(uint32_t freq)
+void R820T2_plan_freq(uint32_t freq, r820t_plan *p)
 {
   /* compute desired LO freq */
   uint32_t lo_freq = freq + r820t_if_freq;
@@ -478,10 +637,183 @@ void R820T2_set_freq(uint32_t freq)
   /* calibrate using known error */
   lo_freq = R820T2_correct_freq(lo_freq);
 
-  /* apply to hardware */
-  R820T2_set_tf(freq);
-  R820T2_set_pll(lo_freq);
-  r820t_freq = freq;
+  p->freq = freq;
+  p->n = 0;
+  R820T2_plan_tf(p, freq);
+  R820T2_plan_pll(p, lo_freq);
+}
+
+/*
+ * empty the plan cache
+ */
+void R820T2_plan_clear(void)
+{
+  int i;
+  
+  for(i=0;i<R820T2_PLAN_HASH;i++)
+    r820t_pc_hash[i] = -1;
+  r820t_pc_newest = r820t_pc_oldest = -1;
+  r820t_pc_num = 0;
+  r820t_pc_xtal = r820t_xtal_freq;
+  r820t_pc_if = r820t_if_freq;
+}
+
+static inline uint32_t R820T2_plan_bucket(uint32_t key)
+{
+  return ((uint32_t)(key * 2654435761U) >> 16) & (R820T2_PLAN_HASH-1);
+}
+
+/*
+ * take a plan off the LRU list
+ */
+static void R820T2_plan_unlink(int16_t e)
+{
+  r820t_plan_ent *p = &r820t_pc[e];
+  
+  if(p->newer >= 0)
+    r820t_pc[p->newer].older = p->older;
+  else
+    r820t_pc_newest = p->older;
+  if(p->older >= 0)
+    r820t_pc[p->older].newer = p->newer;
+  else
+    r820t_pc_oldest = p->newer;
+}
+
+/*
+ * put a plan at the recently used end
+ */
+static void R820T2_plan_touch(int16_t e)
+{
+  r820t_pc[e].newer = -1;
+  r820t_pc[e].older = r820t_pc_newest;
+  if(r820t_pc_newest >= 0)
+    r820t_pc[r820t_pc_newest].newer = e;
+  else
+    r820t_pc_oldest = e;
+  r820t_pc_newest = e;
+}
+
+/*
+ * plan for a frequency rounded to r820t_plan_step, from the cache when
+ * it's there. The pointer is good until the next lookup.
+ */
+const r820t_plan *R820T2_plan_get(uint32_t freq)
+{
+  uint32_t key, b;
+  int16_t e, *pe;
+  
+  if(r820t_pc_num < 0 || r820t_pc_xtal != r820t_xtal_freq ||
+    r820t_pc_if != r820t_if_freq)
+    R820T2_plan_clear();
+  
+  key = freq;
+  if(r820t_plan_step > 1)
+    key = (uint32_t)(((uint64_t)freq + r820t_plan_step/2) / r820t_plan_step) *
+      r820t_plan_step;
+  b = R820T2_plan_bucket(key);
+  
+  /* hit */
+  for(e=r820t_pc_hash[b];e>=0;e=r820t_pc[e].chain)
+  {
+    if(r820t_pc[e].plan.freq == key)
+    {
+      r820t_plan_hits++;
+      if(e != r820t_pc_newest)
+      {
+        R820T2_plan_unlink(e);
+        R820T2_plan_touch(e);
+      }
+      return &r820t_pc[e].plan;
+    }
+  }
+  
+  /* miss - take a free entry or the least recently used */
+  r820t_plan_misses++;
+  if(r820t_pc_num < R820T2_PLAN_CACHE)
+    e = r820t_pc_num++;
+  else
+  {
+    e = r820t_pc_oldest;
+    R820T2_plan_unlink(e);
+    pe = &r820t_pc_hash[R820T2_plan_bucket(r820t_pc[e].plan.freq)];
+    while(*pe != e)
+      pe = &r820t_pc[*pe].chain;
+    *pe = r820t_pc[e].chain;
+  }
+  R820T2_plan_freq(key, &r820t_pc[e].plan);
+  r820t_pc[e].chain = r820t_pc_hash[b];
+  r820t_pc_hash[b] = e;
+  R820T2_plan_touch(e);
+  return &r820t_pc[e].plan;
+}
+
+/*
+ * fill the cache for a channel plan ahead of time - returns how many
+ * channels went in, it stops when the cache is full
+ */
+int R820T2_plan_prefill(uint32_t start, uint32_t stop, uint32_t step)
+{
+  uint64_t f;
+  int n = 0;
+  
+  if(!step)
+    return 0;
+  for(f=start;f<=stop && n<R820T2_PLAN_CACHE;f+=step)
+  {
+    R820T2_plan_get(f);
+    n++;
+  }
+  return n;
+}
+
+/*
+ * hit rate & size
+ */
+void R820T2_plan_report(FILE *fd)
+{
+  unsigned long n = r820t_plan_hits + r820t_plan_misses;
+  
+  fprintf(fd, "r820t2 plans: %d of %d cached, step %u Hz, %lu hits, %lu misses (%.1f%% hit)\n",
+    r820t_pc_num < 0 ? 0 : r820t_pc_num, R820T2_PLAN_CACHE, r820t_plan_step,
+    r820t_plan_hits, r820t_plan_misses, n ? 100.0F * r820t_plan_hits / n : 0.0F);
+}
+
+/*
+ * retune from a plan - one bus transaction
+ */
+void R820T2_set_plan(const r820t_plan *p)
+{
+  R820T2_plan_load(p);
+  R820T2_i2c_flush();
+  r820t_freq = p->freq;
+}
+
+/*
+ * IF that freq comes out at when tuned with plan p - the plan may be for
+ * freq rounded to r820t_plan_step, so the DDC takes up the difference.
+ * The LO is above the signal.
+ */
+uint32_t R820T2_plan_if(const r820t_plan *p, uint32_t freq)
+{
+  return r820t_if_freq + (int32_t)(p->freq - freq);
+}
+
+/*
+ * Update Tracking Filter and LO to exactly freq - from the cache when
+ * freq is on the plan step, else planned here
+ */
+void R820T2_set_freq(uint32_t freq)
+{
+  r820t_plan p;
+  
+  if(r820t_plan_step <= 1 || freq % r820t_plan_step == 0)
+  {
+    R820T2_set_plan(R820T2_plan_get(freq));
+    return;
+  }
+  R820T2_plan_freq(freq, &p);
+  R820T2_set_plan(&p);
 }
 
 /*
@@ -489,7 +821,8 @@ void R820T2_set_freq(uint32_t freq)
  */
 void R820T2_set_lna_gain(uint8_t gain_index)
 {
-  R820T2_i2c_write_cache_mask(0x05, gain_index, 0x0f);
+  R820T2_reg_set_mask(0x05, gain_index, 0x0f);
+  R820T2_i2c_flush();
 }
 
 /*
@@ -497,7 +830,8 @@ void R820T2_set_lna_gain(uint8_t gain_index)
  */
 void R820T2_set_mixer_gain(uint8_t gain_index)
 {
-  R820T2_i2c_write_cache_mask(0x07, gain_index, 0x0f);
+  R820T2_reg_set_mask(0x07, gain_index, 0x0f);
+  R820T2_i2c_flush();
 }
 
 /*
@@ -505,7 +839,8 @@ void R820T2_set_mixer_gain(uint8_t gain_index)
  */
 void R820T2_set_vga_gain(uint8_t gain_index)
 {
-  R820T2_i2c_write_cache_mask(0x0c, gain_index, 0x0f);
+  R820T2_reg_set_mask(0x0c, gain_index, 0x0f);
+  R820T2_i2c_flush();
 }
 
 /*
@@ -514,7 +849,8 @@ void R820T2_set_vga_gain(uint8_t gain_index)
 void R820T2_set_lna_agc(uint8_t value)
 {
   value = value != 0 ? 0x00 : 0x10;
-  R820T2_i2c_write_cache_mask(0x05, value, 0x10);
+  R820T2_reg_set_mask(0x05, value, 0x10);
+  R820T2_i2c_flush();
 }
 
 /*
@@ -523,7 +859,8 @@ void R820T2_set_lna_agc(uint8_t value)
 void R820T2_set_mixer_agc(uint8_t value)
 {
   value = value != 0 ? 0x10 : 0x00;
-  R820T2_i2c_write_cache_mask(0x07, value, 0x10);
+  R820T2_reg_set_mask(0x07, value, 0x10);
+  R820T2_i2c_flush();
 }
 
 /*
@@ -534,8 +871,9 @@ void R820T2_set_if_bandwidth(uint8_t bw)
     const uint8_t modes[] = { 0xE0, 0x80, 0x60, 0x00 };
     uint8_t a = 0xB0 | (0x0F-(bw & 0x0F));
     uint8_t b = 0x0F | modes[(bw & 0x3) >> 4];
-    R820T2_i2c_write_reg(0x0A, a);
-    R820T2_i2c_write_reg(0x0B, b);
+    R820T2_reg_set(0x0A, a);
+    R820T2_reg_set(0x0B, b);
+    R820T2_i2c_flush();
 }
 
 /*
@@ -553,27 +891,31 @@ int32_t R820T2_calibrate(void)
   for (i = 0; i < 5; i++)
   {
     /* Set filt_cap */
-    R820T2_i2c_write_cache_mask(0x0b, 0x08, 0x60);
+    R820T2_reg_set_mask(0x0b, 0x08, 0x60);
 
     /* set cali clk =on */
-    R820T2_i2c_write_cache_mask(0x0f, 0x04, 0x04);
+    R820T2_reg_set_mask(0x0f, 0x04, 0x04);
 
     /* X'tal cap 0pF for PLL */
-    R820T2_i2c_write_cache_mask(0x10, 0x00, 0x03);
+    R820T2_reg_set_mask(0x10, 0x00, 0x03);
 
     /* freq used for calibration */
     R820T2_set_pll(CALIBRATION_LO * 1000);
+    
+    /* flush goes in address order - setup must land before the trigger */
+    R820T2_i2c_flush();
 
     /* Start Trigger */
-    R820T2_i2c_write_cache_mask(0x0b, 0x10, 0x10);
+    R820T2_reg_set_mask(0x0b, 0x10, 0x10);
+    R820T2_i2c_flush();
 
     usleep(2000);
 
     /* Stop Trigger */
-    R820T2_i2c_write_cache_mask(0x0b, 0x00, 0x10);
+    R820T2_reg_set_mask(0x0b, 0x00, 0x10);
 
     /* set cali clk =off */
-    R820T2_i2c_write_cache_mask(0x0f, 0x00, 0x04);
+    R820T2_reg_set_mask(0x0f, 0x00, 0x04);
 
     /* Check if calibration worked */
     cal_code = R820T2_i2c_read_reg_uncached(0x04) & 0x0f;
@@ -617,14 +959,21 @@ uint8_t R820T2_init(uint8_t verbose)
     r820t_if_freq = 5000000;
     r820t_freq = 144000000;
     
-    /* initialize the device */
+    /* initialize the device - chip contents unknown so all get written */
+    r820t_hw_valid = 0;
     for(i=R820T2_WRITE_START;i<R820T2_NUM_REGS;i++)
     {
 		if(verbose)
 			fprintf(stderr, "R820T2_init: writing reg %02X = %02X\n", i,
 				r82xx_init_array[i]);
-        R820T2_i2c_write_reg(i, r82xx_init_array[i]);
+        R820T2_reg_set(i, r82xx_init_array[i]);
 	}
+    if(R820T2_i2c_flush())
+    {
+        if(verbose)
+			fprintf(stderr, "R820T2_init: register write failed\n");
+        return 1;
+    }
 
     /* Calibrate */
     if(R820T2_calibrate())
@@ -8,17 +8,43 @@
 
 #include "main.h"
 
+/* register updates for one tuning - the most any frequency needs */
+#define R820T2_PLAN_MAX 12
+
+typedef struct
+{
+	uint32_t freq;
+	uint8_t n;
+	uint8_t reg[R820T2_PLAN_MAX];
+	uint8_t val[R820T2_PLAN_MAX];
+	uint8_t mask[R820T2_PLAN_MAX];
+} r820t_plan;
+
+/* tuning plans cached & default frequency quantization */
+#define R820T2_PLAN_CACHE 256
+#define R820T2_PLAN_STEP 1
+
 extern uint32_t r820t_freq;
 extern uint32_t r820t_xtal_freq;
 extern uint32_t r820t_if_freq;
+extern uint32_t r820t_plan_step;
+extern unsigned long r820t_plan_hits, r820t_plan_misses;
 
 uint8_t R820T2_init(uint8_t verbose);
 void R820T2_free(void);
 void R820T2_i2c_write_reg(uint8_t reg, uint8_t data);
+uint8_t R820T2_i2c_flush(void);
 uint8_t R820T2_i2c_read_raw(uint8_t *data, uint8_t sz);
 uint8_t R820T2_i2c_read_reg_uncached(uint8_t reg);
 uint8_t R820T2_i2c_read_reg_cached(uint8_t reg);
 void R820T2_set_freq(uint32_t freq);
+void R820T2_plan_freq(uint32_t freq, r820t_plan *p);
+void R820T2_set_plan(const r820t_plan *p);
+void R820T2_plan_clear(void);
+const r820t_plan *R820T2_plan_get(uint32_t freq);
+uint32_t R820T2_plan_if(const r820t_plan *p, uint32_t freq);
+int R820T2_plan_prefill(uint32_t start, uint32_t stop, uint32_t step);
+void R820T2_plan_report(FILE *fd);
 void R820T2_set_lna_gain(uint8_t gain_index);
 void R820T2_set_mixer_gain(uint8_t gain_index);
 void R820T2_set_vga_gain(uint8_t gain_index);
@@ -0,0 +1,225 @@
+/*
+ * replay.c - file-driven I/Q replay backend
+ * 10-16-26 E. Brombaugh
+ *
+ * Reads interleaved S16 I/Q from a WAV or headerless raw file and writes
+ * the demodulated stereo audio back out in the same format, chosen by
+ * the output file extension. No FPGA, I2C or ALSA access.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "main.h"
+#include "replay.h"
+
+/* state */
+static char *replay_in_name, *replay_out_name;
+static FILE *replay_in, *replay_out;
+static uint8_t replay_in_wav;
+static uint32_t replay_in_bytes;
+static uint8_t replay_out_wav;
+static uint32_t replay_out_bytes;
+
+/*
+ * set file names before open
+ */
+void replay_set_files(char *in, char *out)
+{
+	replay_in_name = in;
+	replay_out_name = out;
+}
+
+/*
+ * little-endian helpers
+ */
+static uint32_t rd_le32(uint8_t *p)
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint16_t rd_le16(uint8_t *p)
+{
+	return p[0] | (p[1]<<8);
+}
+
+static void wr_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void wr_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v; p[1] = v>>8;
+}
+
+/*
+ * check for a WAV header & skip to the data chunk, noting its length so
+ * nothing after it is read as I/Q. Leaves the file at the start for raw
+ * input.
+ */
+static int replay_parse_wav(FILE *f)
+{
+	uint8_t hdr[12], chk[8], fmt[16];
+	uint32_t sz;
+
+	if(fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) ||
+		memcmp(hdr+8, "WAVE", 4))
+	{
+		/* headerless raw S16 stereo */
+		rewind(f);
+		return 0;
+	}
+
+	/* walk the chunks - odd sizes are padded to even */
+	while(fread(chk, 1, 8, f) == 8)
+	{
+		sz = rd_le32(chk+4);
+		if(!memcmp(chk, "fmt ", 4))
+		{
+			if(sz < 16 || fread(fmt, 1, 16, f) != 16)
+				return 1;
+			if(rd_le16(fmt) != 1 || rd_le16(fmt+2) != 2 || rd_le16(fmt+14) != 16)
+			{
+				fprintf(stderr, "replay: WAV must be 16-bit PCM stereo I/Q\n");
+				return 1;
+			}
+			sample_rate = rd_le32(fmt+4);
+			if(fseek(f, (long)(sz - 16) + (sz & 1), SEEK_CUR))
+				break;
+		}
+		else if(!memcmp(chk, "data", 4))
+		{
+			replay_in_wav = 1;
+			replay_in_bytes = sz;
+			return 0;
+		}
+		else if(fseek(f, (long)sz + (sz & 1), SEEK_CUR))
+			break;
+	}
+
+	fprintf(stderr, "replay: no data chunk\n");
+	return 1;
+}
+
+/*
+ * write / patch a 16-bit stereo WAV header
+ */
+static void replay_wav_header(FILE *f, uint32_t data_bytes)
+{
+	uint8_t h[44];
+
+	memcpy(h, "RIFF", 4);
+	wr_le32(h+4, 36 + data_bytes);
+	memcpy(h+8, "WAVEfmt ", 8);
+	wr_le32(h+16, 16);
+	wr_le16(h+20, 1);
+	wr_le16(h+22, 2);
+	wr_le32(h+24, sample_rate);
+	wr_le32(h+28, sample_rate * 4);
+	wr_le16(h+32, 4);
+	wr_le16(h+34, 16);
+	memcpy(h+36, "data", 4);
+	wr_le32(h+40, data_bytes);
+	fwrite(h, 1, 44, f);
+}
+
+/*
+ * open input & output files
+ */
+static int replay_open(void)
+{
+	char *ext;
+
+	if((replay_in = fopen(replay_in_name, "rb")) == NULL)
+	{
+		fprintf(stderr, "replay: can't open %s\n", replay_in_name);
+		return 1;
+	}
+
+	replay_in_wav = 0;
+	if(replay_parse_wav(replay_in))
+	{
+		fclose(replay_in);
+		return 1;
+	}
+
+	replay_out = NULL;
+	replay_out_bytes = 0;
+	if(replay_out_name)
+	{
+		if((replay_out = fopen(replay_out_name, "wb")) == NULL)
+		{
+			fprintf(stderr, "replay: can't open %s\n", replay_out_name);
+			fclose(replay_in);
+			return 1;
+		}
+
+		/* placeholder header, patched on close */
+		ext = strrchr(replay_out_name, '.');
+		replay_out_wav = ext && !strcasecmp(ext, ".wav");
+		if(replay_out_wav)
+			replay_wav_header(replay_out, 0);
+	}
+
+	return 0;
+}
+
+/*
+ * read frames of input - a WAV stops at the end of its data chunk
+ */
+static long replay_read(char *buf, unsigned long frames)
+{
+	long n;
+
+	if(replay_in_wav && frames > replay_in_bytes / 4)
+		frames = replay_in_bytes / 4;
+	n = fread(buf, 4, frames, replay_in);
+	if(replay_in_wav)
+		replay_in_bytes -= n * 4;
+
+	return n;
+}
+
+/*
+ * write frames of output
+ */
+static long replay_write(char *buf, unsigned long frames)
+{
+	long n;
+
+	if(!replay_out)
+		return frames;
+
+	n = fwrite(buf, 4, frames, replay_out);
+	replay_out_bytes += n * 4;
+
+	return n;
+}
+
+/*
+ * close files & fix up WAV sizes
+ */
+static void replay_close(void)
+{
+	fclose(replay_in);
+	if(replay_out)
+	{
+		if(replay_out_wav)
+		{
+			rewind(replay_out);
+			replay_wav_header(replay_out, replay_out_bytes);
+		}
+		fclose(replay_out);
+	}
+}
+
+const audio_backend replay_backend =
+{
+	"replay",
+	replay_open,
+	replay_read,
+	replay_write,
+	replay_close
+};
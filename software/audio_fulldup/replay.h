@@ -0,0 +1,15 @@
+/*
+ * replay.h - file-driven I/Q replay backend
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __replay__
+#define __replay__
+
+#include "backend.h"
+
+extern const audio_backend replay_backend;
+
+void replay_set_files(char *in, char *out);
+
+#endif
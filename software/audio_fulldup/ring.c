@@ -0,0 +1,169 @@
+/*
+ * ring.c - lock-free single producer / single consumer ring of pointers
+ * 10-16-26 E. Brombaugh
+ *
+ * The producer only writes head and the consumer only writes tail so no
+ * locks are needed. A semaphore mirrors the entry count so consumers can
+ * sleep in ring_wait() instead of spinning.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "ring.h"
+
+/*
+ * allocate a ring holding at least size entries
+ */
+int ring_init(spsc_ring *r, uint32_t size)
+{
+	uint32_t sz = 1;
+
+	/* round up to power of 2 */
+	while(sz < size)
+		sz <<= 1;
+
+	if((r->slot = calloc(sz, sizeof(void *))) == NULL)
+		return 1;
+
+	r->mask = sz - 1;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->hwm, 0);
+	sem_init(&r->avail, 0, 0);
+
+	return 0;
+}
+
+/*
+ * release ring storage
+ */
+void ring_free(spsc_ring *r)
+{
+	sem_destroy(&r->avail);
+	free(r->slot);
+	r->slot = NULL;
+}
+
+/*
+ * add an entry - producer side. Returns 1 if full.
+ */
+int ring_put(spsc_ring *r, void *item)
+{
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	uint32_t depth = head - tail;
+
+	if(depth > r->mask)
+		return 1;
+
+	r->slot[head & r->mask] = item;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+	/* track high water mark */
+	depth++;
+	if(depth > atomic_load_explicit(&r->hwm, memory_order_relaxed))
+		atomic_store_explicit(&r->hwm, depth, memory_order_relaxed);
+
+	sem_post(&r->avail);
+
+	return 0;
+}
+
+/*
+ * take an entry without touching the semaphore
+ */
+static void *ring_take(spsc_ring *r)
+{
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	void *item;
+
+	if(head == tail)
+		return NULL;
+
+	item = r->slot[tail & r->mask];
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+	return item;
+}
+
+/*
+ * remove an entry - consumer side. Returns NULL if empty.
+ */
+void *ring_get(spsc_ring *r)
+{
+	void *item;
+
+	/*
+	 * keep the semaphore in step with the entry count. If the producer
+	 * hasn't posted yet the extra count is soaked up by ring_wait().
+	 */
+	if((item = ring_take(r)) != NULL)
+		sem_trywait(&r->avail);
+
+	return item;
+}
+
+/*
+ * wait up to timeout_ms for an entry - consumer side. Returns NULL on
+ * timeout.
+ */
+void *ring_wait(spsc_ring *r, int timeout_ms)
+{
+	struct timespec ts;
+	void *item;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if(ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	while(1)
+	{
+		if((item = ring_get(r)) != NULL)
+			return item;
+
+		if(sem_timedwait(&r->avail, &ts) == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			return NULL;
+		}
+
+		/* count already consumed - a stale count just loops again */
+		if((item = ring_take(r)) != NULL)
+			return item;
+	}
+}
+
+/*
+ * current number of entries - safe from any thread. tail is read first:
+ * head can only have moved on since, so the count never goes negative.
+ */
+uint32_t ring_depth(spsc_ring *r)
+{
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+	return atomic_load_explicit(&r->head, memory_order_acquire) - tail;
+}
+
+/*
+ * largest number of entries seen since init / reset
+ */
+uint32_t ring_hwm(spsc_ring *r)
+{
+	return atomic_load_explicit(&r->hwm, memory_order_relaxed);
+}
+
+/*
+ * restart high water mark tracking
+ */
+void ring_reset_hwm(spsc_ring *r)
+{
+	atomic_store_explicit(&r->hwm, ring_depth(r), memory_order_relaxed);
+}
@@ -0,0 +1,32 @@
+/*
+ * ring.h - lock-free single producer / single consumer ring of pointers
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __ring__
+#define __ring__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+typedef struct
+{
+	void **slot;			/* ring storage */
+	uint32_t mask;			/* size - 1, size is a power of 2 */
+	atomic_uint head;		/* next write, owned by producer */
+	atomic_uint tail;		/* next read, owned by consumer */
+	atomic_uint hwm;		/* high water mark of depth */
+	sem_t avail;			/* counts entries for blocking consumers */
+} spsc_ring;
+
+int ring_init(spsc_ring *r, uint32_t size);
+void ring_free(spsc_ring *r);
+int ring_put(spsc_ring *r, void *item);
+void *ring_get(spsc_ring *r);
+void *ring_wait(spsc_ring *r, int timeout_ms);
+uint32_t ring_depth(spsc_ring *r);
+uint32_t ring_hwm(spsc_ring *r);
+void ring_reset_hwm(spsc_ring *r);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * rt.c - real-time scheduling, CPU pinning & memory locking
+ * 10-16-26 E. Brombaugh
+ *
+ * Audio threads are created through rt_thread_create() so they can run
+ * SCHED_FIFO and optionally be pinned to one core, or kept off it. If the
+ * RT attributes are refused the thread is started with default scheduling
+ * anyway and the failure is reported once, so an unprivileged run still
+ * works.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "rt.h"
+
+int rt_prio = 0;
+int rt_cpu = -1;
+
+/* what we actually got */
+int rt_refused = 0, rt_pin_failed = 0, rt_locked = 0, rt_threads = 0;
+
+/* thread start info */
+typedef struct
+{
+	void *(*fn)(void *);
+	void *arg;
+} rt_start;
+
+/*
+ * touch the stack we'll be using so the first period doesn't fault
+ */
+static void *rt_trampoline(void *ptr)
+{
+	rt_start s = *(rt_start *)ptr;
+	volatile char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	free(ptr);
+	for(i=0;i<sizeof(stack);i+=4096)
+		stack[i] = 0;
+
+	return s.fn(s.arg);
+}
+
+/*
+ * thread attributes - SCHED_FIFO if sched, cores by pin mode
+ */
+static void rt_attr(pthread_attr_t *attr, int sched, int pin)
+{
+	struct sched_param sp;
+	cpu_set_t cpus;
+	long i, cores;
+
+	pthread_attr_init(attr);
+	pthread_attr_setstacksize(attr, RT_STACK_SIZE);
+	if(sched)
+	{
+		pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+		sp.sched_priority = rt_prio;
+		pthread_attr_setschedparam(attr, &sp);
+	}
+	if(pin == RT_PIN_AUDIO)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(rt_cpu, &cpus);
+		pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+	}
+	else if(pin == RT_PIN_AWAY)
+	{
+		CPU_ZERO(&cpus);
+		cores = sysconf(_SC_NPROCESSORS_ONLN);
+		for(i=0;i<cores && i<CPU_SETSIZE;i++)
+			if(i != rt_cpu)
+				CPU_SET(i, &cpus);
+		pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+	}
+}
+
+/*
+ * start a thread with the RT settings. pin is RT_PIN_AUDIO for the audio
+ * threads, RT_PIN_AWAY for helpers that must not compete with them at the
+ * same priority or RT_PIN_ANY to leave it to the scheduler.
+ */
+int rt_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg,
+	int pin)
+{
+	pthread_attr_t attr;
+	rt_start *s;
+	int err, sched = rt_prio && !rt_refused;
+
+	if((s = malloc(sizeof(rt_start))) == NULL)
+		return ENOMEM;
+	s->fn = fn;
+	s->arg = arg;
+	if(rt_cpu < 0 || rt_pin_failed)
+		pin = RT_PIN_ANY;
+
+	rt_attr(&attr, sched, pin);
+	err = pthread_create(thread, &attr, rt_trampoline, s);
+	pthread_attr_destroy(&attr);
+
+	/* no RT privileges - carry on with default scheduling */
+	if(err == EPERM && sched)
+	{
+		fprintf(stderr, "rt: SCHED_FIFO priority %d refused (%s) - "
+			"check RLIMIT_RTPRIO or run as root\n", rt_prio, strerror(err));
+		rt_refused = 1;
+		sched = 0;
+		rt_attr(&attr, sched, pin);
+		err = pthread_create(thread, &attr, rt_trampoline, s);
+		pthread_attr_destroy(&attr);
+	}
+
+	/* core not available */
+	if(err == EINVAL && pin)
+	{
+		fprintf(stderr, "rt: can't %s cpu %d (%s)\n",
+			pin == RT_PIN_AWAY ? "keep off" : "pin to", rt_cpu, strerror(err));
+		rt_pin_failed = 1;
+		rt_attr(&attr, sched, RT_PIN_ANY);
+		err = pthread_create(thread, &attr, rt_trampoline, s);
+		pthread_attr_destroy(&attr);
+	}
+
+	if(err)
+		free(s);
+	else
+		rt_threads++;
+	return err;
+}
+
+/*
+ * lock everything mapped now & later into RAM
+ */
+int rt_lock_memory(void)
+{
+	if(mlockall(MCL_CURRENT | MCL_FUTURE))
+	{
+		fprintf(stderr, "rt: mlockall failed (%s) - check RLIMIT_MEMLOCK "
+			"or run as root\n", strerror(errno));
+		return 1;
+	}
+	rt_locked = 1;
+	return 0;
+}
+
+/*
+ * fault in a buffer's pages without changing its contents
+ */
+void rt_prefault(void *buf, size_t len)
+{
+	volatile char *p = buf;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	if(!p || !len)
+		return;
+	if(page <= 0)
+		page = 4096;
+	for(i=0;i<len;i+=page)
+		p[i] = p[i];
+	p[len-1] = p[len-1];
+}
+
+/*
+ * one line summary of what the audio threads are running with
+ */
+void rt_report(void)
+{
+	if(rt_prio)
+		fprintf(stderr, "rt: %d threads, %s", rt_threads,
+			rt_refused ? "default scheduling" : "SCHED_FIFO");
+	else
+		fprintf(stderr, "rt: %d threads, default scheduling", rt_threads);
+	if(rt_prio && !rt_refused)
+		fprintf(stderr, " priority %d", rt_prio);
+	if(rt_cpu >= 0)
+		fprintf(stderr, rt_pin_failed ? ", pinning to cpu %d failed" :
+			", pinned to cpu %d", rt_cpu);
+	fprintf(stderr, ", memory %slocked\n", rt_locked ? "" : "not ");
+}
@@ -0,0 +1,32 @@
+/*
+ * rt.h - real-time scheduling, CPU pinning & memory locking
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __rt__
+#define __rt__
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* RT thread stack - all of it is locked under mlockall(MCL_FUTURE) */
+#define RT_STACK_SIZE (256*1024)
+
+/* stack touched by each RT thread before it starts work */
+#define RT_STACK_PREFAULT (64*1024)
+
+extern int rt_prio;		/* SCHED_FIFO priority, 0 = default scheduling */
+extern int rt_cpu;		/* core for the audio threads, -1 = any */
+
+/* rt_thread_create() pin modes - only apply when rt_cpu is set */
+#define RT_PIN_ANY 0		/* any core */
+#define RT_PIN_AUDIO 1		/* the audio core */
+#define RT_PIN_AWAY 2		/* any core but the audio one */
+
+int rt_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg,
+	int pin);
+int rt_lock_memory(void);
+void rt_prefault(void *buf, size_t len);
+void rt_report(void);
+
+#endif
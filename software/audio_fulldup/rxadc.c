@@ -1,39 +1,509 @@
 /*
  * rxadc.c - access routines for rxadc FPGA functions
  * 07-06-20 E. Brombaugh
+ *
+ * The control registers are only ever written by the host, so they are
+ * shadowed here: reads come from memory and writes of an unchanged value
+ * are dropped. Status registers the FPGA updates itself are refreshed by
+ * one background poller instead of every caller going to the SPI bus.
+ *
+ * The poller, the hwq worker & the display all get at the shadow, so each
+ * slot is one atomic word holding the value & a valid bit. The display
+ * only ever peeks at it - it never goes to the bus.
  */
 
 #include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 #include "rxadc.h"
 #include "main.h"
 
+/* register ownership */
+enum rxadc_reg_types
+{
+	RXADC_UNCACHED,		/* always goes to the hardware */
+	RXADC_HOST,			/* only the host writes it */
+	RXADC_VOLATILE		/* FPGA status - refreshed by the poller */
+};
+
+static const uint8_t rxadc_reg_type[RXADC_SHADOW_NUM] =
+{
+	RXADC_HOST,			/* RXADC_REG_LO */
+	RXADC_HOST,			/* RXADC_REG_DACMUX */
+	RXADC_HOST,			/* RXADC_REG_NSENA */
+	RXADC_HOST,			/* RXADC_REG_CICSHF */
+	RXADC_UNCACHED,		/* 0x14 */
+	RXADC_VOLATILE		/* RXADC_REG_CICSAT */
+};
+
+/* shadow registers - value in the low 32 bits */
+#define RXADC_SHADOW_VALID (1ULL<<32)
+static atomic_ullong rxadc_shadow[RXADC_SHADOW_NUM];
+atomic_ulong rxadc_reads_cached, rxadc_writes_elided;
+
+/* status poller */
+int rxadc_poll_hz = RXADC_POLL_HZ;
+static pthread_t rxadc_poll_thread;
+static pthread_mutex_t rxadc_poll_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rxadc_poll_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int rxadc_polling;
+static int rxadc_poll_exit;
+
+/*
+ * shadow slot for a register, -1 if it isn't shadowed
+ */
+static int rxadc_slot(uint8_t reg, int type)
+{
+	int idx = reg - RXADC_SHADOW_BASE;
+
+	if(idx < 0 || idx >= RXADC_SHADOW_NUM || rxadc_reg_type[idx] != type)
+		return -1;
+	return idx;
+}
+
+/*
+ * shadow access - any thread
+ */
+static int rxadc_shadow_get(int idx, uint32_t *data)
+{
+	unsigned long long v = atomic_load_explicit(&rxadc_shadow[idx],
+		memory_order_relaxed);
+
+	*data = v;
+	return (v & RXADC_SHADOW_VALID) != 0;
+}
+
+static void rxadc_shadow_set(int idx, uint32_t data)
+{
+	atomic_store_explicit(&rxadc_shadow[idx], RXADC_SHADOW_VALID | data,
+		memory_order_relaxed);
+}
+
+/* keeps the last value for rxadc_peek() */
+static void rxadc_shadow_clear(int idx)
+{
+	atomic_fetch_and_explicit(&rxadc_shadow[idx], ~RXADC_SHADOW_VALID,
+		memory_order_relaxed);
+}
+
+/*
+ * read a register - host owned ones come from the shadow
+ */
+uint32_t rxadc_read_reg(uint8_t reg)
+{
+	uint32_t data = 0;
+	int idx = rxadc_slot(reg, RXADC_HOST);
+
+	if(idx >= 0 && rxadc_shadow_get(idx, &data))
+	{
+		rxadc_reads_cached++;
+		return data;
+	}
+
+	if(ice_read(bs, reg, &data))
+		return 0;
+	if(idx >= 0)
+		rxadc_shadow_set(idx, data);
+	return data;
+}
+
+/*
+ * write a register - skipped if a host owned one already holds the value
+ */
+void rxadc_write_reg(uint8_t reg, uint32_t data)
+{
+	int idx = rxadc_slot(reg, RXADC_HOST);
+	uint32_t old;
+
+	if(idx >= 0 && rxadc_shadow_get(idx, &old) && old == data)
+	{
+		rxadc_writes_elided++;
+		return;
+	}
+
+	if(ice_write(bs, reg, data))
+	{
+		/* don't know what the hardware has now */
+		if(idx >= 0)
+			rxadc_shadow_clear(idx);
+		return;
+	}
+	if(idx >= 0)
+		rxadc_shadow_set(idx, data);
+}
+
+/*
+ * running image's ID & build hash
+ */
+static int rxadc_get_build(uint32_t *id, uint32_t *build)
+{
+	ice_batch b;
+
+	ice_batch_init(&b);
+	ice_batch_read(&b, RXADC_REG_ID, id);
+	ice_batch_read(&b, RXADC_REG_BUILD, build);
+	return ice_batch_run(bs, &b);
+}
+
+/* what the cache records about a loaded bitstream */
+typedef struct
+{
+	long long size, mtime_s;
+	long mtime_ns;
+	uint32_t hash, id, build;
+} rxadc_cfg_rec;
+
+/*
+ * read back the record of the last load of bitfile
+ */
+static int rxadc_cache_read(char *bitfile, rxadc_cfg_rec *r)
+{
+	FILE *fd;
+	char path[256];
+	int match = 0;
+
+	if(!(fd = fopen(RXADC_CFG_CACHE, "r")))
+		return 0;
+	if(fscanf(fd, "%255s %lld %lld %ld %x %x %x", path, &r->size, &r->mtime_s,
+		&r->mtime_ns, &r->hash, &r->id, &r->build) == 7)
+		match = !strcmp(path, bitfile);
+	fclose(fd);
+	return match;
+}
+
+/*
+ * remember what was just loaded
+ */
+static void rxadc_cache_save(char *bitfile, const rxadc_cfg_rec *r)
+{
+	FILE *fd;
+	char tmp[] = RXADC_CFG_CACHE ".tmp";
+
+	if(!(fd = fopen(tmp, "w")))
+		return;
+	fprintf(fd, "%s %lld %lld %ld %08X %08X %08X\n", bitfile, r->size,
+		r->mtime_s, r->mtime_ns, r->hash, r->id, r->build);
+	if(fclose(fd) || rename(tmp, RXADC_CFG_CACHE))
+		remove(tmp);
+}
+
+/*
+ * make sure the FPGA is running bitfile. Configuring is skipped when the
+ * running ID & build hash are what the cache recorded for this bitstream.
+ * A file with the cached size & mtime is taken as unchanged without reading
+ * it; otherwise it is loaded once, hashed and sent from the same buffer.
+ */
+int rxadc_configure(char *bitfile, uint32_t cfg_speed, int verbose)
+{
+	uint32_t id, build;
+	rxadc_cfg_rec now, old;
+	ice_bitstream b;
+	struct stat st;
+	int have_old, err;
+
+	if(rxadc_get_build(&id, &build))
+	{
+		fprintf(stderr, "Error reading ID\n");
+		return 1;
+	}
+
+	/* can't check or configure - stay with what's running */
+	if(stat(bitfile, &st))
+	{
+		if((id & RXADC_ID_MASK) == RXADC_ID)
+		{
+			if(verbose)
+				fprintf(stderr, "Can't read %s - keeping running FPGA image\n",
+					bitfile);
+			return 0;
+		}
+		fprintf(stderr, "Can't read %s\n", bitfile);
+		return 1;
+	}
+	now.size = st.st_size;
+	now.mtime_s = st.st_mtim.tv_sec;
+	now.mtime_ns = st.st_mtim.tv_nsec;
+	have_old = rxadc_cache_read(bitfile, &old);
+
+	/* build hash 0 is gateware without the register - can't tell */
+	if((id & RXADC_ID_MASK) == RXADC_ID && build && have_old &&
+		old.id == id && old.build == build && old.size == now.size &&
+		old.mtime_s == now.mtime_s && old.mtime_ns == now.mtime_ns)
+	{
+		if(verbose)
+			fprintf(stderr, "FPGA already running %s (build %08X)\n",
+				bitfile, build);
+		return 0;
+	}
+
+	/* file changed or unknown - load it once for both checking & sending */
+	if(ice_load_bitfile(bs, bitfile, &b))
+	{
+		fprintf(stderr, "Error loading %s\n", bitfile);
+		return 1;
+	}
+	now.hash = ice_hash_bitstream(&b);
+
+	if((id & RXADC_ID_MASK) == RXADC_ID)
+	{
+		/* touched or copied but the same contents */
+		if(build && have_old && old.id == id && old.build == build &&
+			old.hash == now.hash)
+		{
+			if(verbose)
+				fprintf(stderr, "FPGA already running %s (build %08X)\n",
+					bitfile, build);
+			ice_free_bitfile(&b);
+			now.id = id;
+			now.build = build;
+			rxadc_cache_save(bitfile, &now);
+			return 0;
+		}
+		if(verbose)
+			fprintf(stderr, "FPGA build %08X not known to match %s\n", build,
+				bitfile);
+	}
+	else if(verbose)
+		fprintf(stderr, "ID mismatch - Expected 0x%06X, got 0x%06X\n",
+			RXADC_ID>>8, id>>8);
+
+	/* Configure FPGA */
+	if(verbose)
+		fprintf(stderr, "Configuring FPGA\n");
+	ice_set_cfg_speed(bs, cfg_speed);
+	err = ice_cfg_bitstream(bs, &b);
+	ice_free_bitfile(&b);
+	if(err)
+	{
+		fprintf(stderr, "Error sending bitstream to FPGA\n");
+		return 1;
+	}
+	fprintf(stderr, "FPGA configured in %.1f ms\n", bs->cfg_ms);
+
+	/* Update ID */
+	if(rxadc_get_build(&now.id, &now.build))
+	{
+		fprintf(stderr, "Error reading ID\n");
+		return 1;
+	}
+	rxadc_cache_save(bitfile, &now);
+
+	return 0;
+}
+
+/*
+ * load the shadow from the hardware - call after (re)configuring the FPGA
+ */
+int rxadc_init(void)
+{
+	ice_batch b;
+	uint32_t data[RXADC_SHADOW_NUM];
+	int i;
+
+	ice_batch_init(&b);
+	for(i=0;i<RXADC_SHADOW_NUM;i++)
+		if(rxadc_reg_type[i] != RXADC_UNCACHED)
+			ice_batch_read(&b, RXADC_SHADOW_BASE+i, &data[i]);
+	if(ice_batch_run(bs, &b))
+	{
+		fprintf(stderr, "rxadc_init: error reading registers\n");
+		rxadc_invalidate();
+		return 1;
+	}
+
+	for(i=0;i<RXADC_SHADOW_NUM;i++)
+		if(rxadc_reg_type[i] != RXADC_UNCACHED)
+			rxadc_shadow_set(i, data[i]);
+	return 0;
+}
+
+/*
+ * forget the shadow so the next access of each register goes to hardware
+ */
+void rxadc_invalidate(void)
+{
+	int i;
+
+	for(i=0;i<RXADC_SHADOW_NUM;i++)
+		rxadc_shadow_clear(i);
+}
+
+/*
+ * poller - refreshes the volatile status registers
+ */
+static void *rxadc_poll_loop(void *arg)
+{
+	struct timespec ts;
+	ice_batch b;
+	uint32_t data[RXADC_SHADOW_NUM];
+	long period_ns;
+	int i;
+
+	pthread_mutex_lock(&rxadc_poll_mutex);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while(!rxadc_poll_exit)
+	{
+		pthread_mutex_unlock(&rxadc_poll_mutex);
+
+		ice_batch_init(&b);
+		for(i=0;i<RXADC_SHADOW_NUM;i++)
+			if(rxadc_reg_type[i] == RXADC_VOLATILE)
+				ice_batch_read(&b, RXADC_SHADOW_BASE+i, &data[i]);
+		if(!ice_batch_run(bs, &b))
+			for(i=0;i<RXADC_SHADOW_NUM;i++)
+				if(rxadc_reg_type[i] == RXADC_VOLATILE)
+					rxadc_shadow_set(i, data[i]);
+
+		/* wait for the next tick or a stop request */
+		pthread_mutex_lock(&rxadc_poll_mutex);
+		period_ns = 1000000000L / rxadc_poll_hz;
+		ts.tv_nsec += period_ns;
+		while(ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_nsec -= 1000000000L;
+			ts.tv_sec++;
+		}
+		while(!rxadc_poll_exit && pthread_cond_timedwait(&rxadc_poll_cond,
+			&rxadc_poll_mutex, &ts) != ETIMEDOUT);
+	}
+	pthread_mutex_unlock(&rxadc_poll_mutex);
+
+	return NULL;
+}
+
+/*
+ * set the status poll rate, 0 stops the poller
+ */
+int rxadc_poll(int hz)
+{
+	pthread_condattr_t ca;
+	int i;
+
+	if(hz < 0 || hz > RXADC_POLL_MAX)
+	{
+		fprintf(stderr, "rxadc_poll: rate must be 0 - %d Hz\n",
+			RXADC_POLL_MAX);
+		return 1;
+	}
+
+	/* stop the running poller */
+	if(rxadc_polling)
+	{
+		pthread_mutex_lock(&rxadc_poll_mutex);
+		rxadc_poll_exit = 1;
+		pthread_cond_signal(&rxadc_poll_cond);
+		pthread_mutex_unlock(&rxadc_poll_mutex);
+		pthread_join(rxadc_poll_thread, NULL);
+		rxadc_polling = 0;
+		for(i=0;i<RXADC_SHADOW_NUM;i++)
+			if(rxadc_reg_type[i] == RXADC_VOLATILE)
+				rxadc_shadow_clear(i);
+	}
+
+	rxadc_poll_hz = hz;
+	if(!hz)
+		return 0;
+
+	/* poller times out against the monotonic clock */
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_destroy(&rxadc_poll_cond);
+	pthread_cond_init(&rxadc_poll_cond, &ca);
+	pthread_condattr_destroy(&ca);
+
+	rxadc_poll_exit = 0;
+	if(pthread_create(&rxadc_poll_thread, NULL, rxadc_poll_loop, NULL))
+	{
+		fprintf(stderr, "rxadc_poll: can't start poller\n");
+		rxadc_poll_hz = 0;
+		return 1;
+	}
+	rxadc_polling = 1;
+	return 0;
+}
+
+/*
+ * volatile register - latest poll if the poller is running
+ */
+static uint32_t rxadc_read_status(uint8_t reg)
+{
+	uint32_t data = 0;
+	int idx = rxadc_slot(reg, RXADC_VOLATILE);
+
+	if(idx >= 0 && rxadc_polling && rxadc_shadow_get(idx, &data))
+		return data;
+
+	if(ice_read(bs, reg, &data))
+		return 0;
+	/* kept for rxadc_peek(), only current while polling */
+	if(idx >= 0)
+		atomic_store_explicit(&rxadc_shadow[idx], data, memory_order_relaxed);
+	return data;
+}
+
+/*
+ * last known value of a shadowed register without going to the bus -
+ * for display threads. Volatile ones are only current while polling.
+ */
+uint32_t rxadc_peek(uint8_t reg)
+{
+	uint32_t data;
+	int idx = reg - RXADC_SHADOW_BASE;
+
+	if(idx < 0 || idx >= RXADC_SHADOW_NUM)
+		return 0;
+	rxadc_shadow_get(idx, &data);
+	return data;
+}
+
+/*
+ * raw LO register to Hz
+ */
+static uint32_t rxadc_lo_hz(uint32_t raw)
+{
+	float32_t frq;
+
+	frq = (float32_t)RXADC_FSAMPLE * (float32_t)raw/((float32_t)(1<<RXADC_LOBITS));
+	return floorf(frq + 0.5F);
+}
+
+/*
+ * LO as last set, no bus access
+ */
+uint32_t rxadc_peek_lo(void)
+{
+	return rxadc_lo_hz(rxadc_peek(RXADC_REG_LO));
+}
+
 /*
  * get hardware LO frequency
  */
 uint32_t rxadc_get_lo(void)
 {
-	uint32_t freqHz;
-	float32_t frq;
-	
-	/* get raw LO frequency scaled to sample rate */
-	ice_read(bs, RXADC_REG_LO, &freqHz);
-	
-	/* convert to Hz */
-	frq = (float32_t)RXADC_FSAMPLE * (float32_t)freqHz/((float32_t)(1<<RXADC_LOBITS));
-	freqHz = floorf(frq + 0.5F);
-	
-	return freqHz;
+	/* get raw LO frequency scaled to sample rate & convert to Hz */
+	return rxadc_lo_hz(rxadc_read_reg(RXADC_REG_LO));
 }
 
 /*
- * set hardware LO frequency
+ * convert Hz to raw LO register value
  */
-uint32_t rxadc_set_lo(uint32_t freqHz)
+uint32_t rxadc_lo_raw(uint32_t freqHz)
 {
 	/* scale to sample rate */
 	float32_t frq = ((float32_t)(1<<RXADC_LOBITS)) * (float32_t)freqHz/(float32_t)RXADC_FSAMPLE;
-	freqHz = floorf(frq + 0.5F);
-	ice_write(bs, RXADC_REG_LO, freqHz);
+	return floorf(frq + 0.5F);
+}
+
+/*
+ * set hardware LO frequency
+ */
+uint32_t rxadc_set_lo(uint32_t freqHz)
+{
+	rxadc_write_reg(RXADC_REG_LO, rxadc_lo_raw(freqHz));
 	
 	/* return actual frequency */
 	return rxadc_get_lo();
@@ -44,7 +514,7 @@ uint32_t rxadc_set_lo(uint32_t freqHz)
  */
 void rxadc_set_dacmux(uint8_t state)
 {
-	ice_write(bs, RXADC_REG_DACMUX, state);
+	rxadc_write_reg(RXADC_REG_DACMUX, state);
 }
 
 /*
@@ -52,11 +522,7 @@ void rxadc_set_dacmux(uint8_t state)
  */
 uint8_t rxadc_get_ifgain(void)
 {
-	uint32_t cic_shift;
-	
-	ice_read(bs, RXADC_REG_CICSHF, &cic_shift);
-	
-	return cic_shift;
+	return rxadc_read_reg(RXADC_REG_CICSHF);
 }
 
 /*
@@ -64,7 +530,7 @@ uint8_t rxadc_get_ifgain(void)
  */
 void rxadc_set_ifgain(uint8_t cic_shift)
 {
-	ice_write(bs, RXADC_REG_CICSHF, cic_shift);
+	rxadc_write_reg(RXADC_REG_CICSHF, cic_shift);
 }
 
 /*
@@ -72,10 +538,15 @@ void rxadc_set_ifgain(uint8_t cic_shift)
  */
 uint8_t rxadc_get_cicsat(void)
 {
-	uint32_t cic_sat;
-	
-	ice_read(bs, RXADC_REG_CICSAT, &cic_sat);
-	
-	return cic_sat;
+	return rxadc_read_status(RXADC_REG_CICSAT);
 }
 
+/*
+ * IF gain & CIC saturation count for status displays - from the shadow
+ * only, so safe off the hwq worker. The count is as of the last poll.
+ */
+void rxadc_get_status(uint8_t *cic_shift, uint8_t *cic_sat)
+{
+	*cic_shift = rxadc_peek(RXADC_REG_CICSHF);
+	*cic_sat = rxadc_peek(RXADC_REG_CICSAT);
+}
@@ -6,14 +6,31 @@
 #ifndef __rxadc__
 #define __rxadc__
 
+#include <stdatomic.h>
 #include "main.h"
 
 #define RXADC_FSAMPLE 50000000
 #define RXADC_LOBITS 26
 
+/* design ID - low byte is the revision */
+#define RXADC_ID 0xADC50000
+#define RXADC_ID_MASK 0xFFFFFF00
+
+/* what was last loaded - the FPGA keeps its image across our restarts */
+#define RXADC_CFG_CACHE "/tmp/rxadc_fpga.cache"
+
+/* registers covered by the shadow */
+#define RXADC_SHADOW_BASE RXADC_REG_LO
+#define RXADC_SHADOW_NUM 6
+
+/* status poll rate, Hz */
+#define RXADC_POLL_HZ 10
+#define RXADC_POLL_MAX 1000
+
 enum rxadc_regs
 {
 	RXADC_REG_ID,
+	RXADC_REG_BUILD = 0x02,
 	RXADC_REG_LO = 0x10,
 	RXADC_REG_DACMUX,
 	RXADC_REG_NSENA,
@@ -27,11 +44,24 @@ enum rxadc_states
 	RXADC_ENABLE
 };
 
+extern int rxadc_poll_hz;
+extern atomic_ulong rxadc_reads_cached, rxadc_writes_elided;
+
+int rxadc_configure(char *bitfile, uint32_t cfg_speed, int verbose);
+int rxadc_init(void);
+void rxadc_invalidate(void);
+int rxadc_poll(int hz);
+uint32_t rxadc_read_reg(uint8_t reg);
+uint32_t rxadc_peek(uint8_t reg);
+void rxadc_write_reg(uint8_t reg, uint32_t data);
+uint32_t rxadc_peek_lo(void);
 uint32_t rxadc_get_lo(void);
+uint32_t rxadc_lo_raw(uint32_t freqHz);
 uint32_t rxadc_set_lo(uint32_t freqHz);
 void rxadc_set_dacmux(uint8_t state);
 uint8_t rxadc_get_ifgain(void);
 void rxadc_set_ifgain(uint8_t cic_shift);
 uint8_t rxadc_get_cicsat(void);
+void rxadc_get_status(uint8_t *cic_shift, uint8_t *cic_sat);
 
 #endif
@@ -0,0 +1,334 @@
+/*
+ * scan.c - frequency hopping scanner
+ * 10-16-26 E. Brombaugh
+ *
+ * The whole scan runs as one long job on the hwq worker so nothing else
+ * touches the SPI or I2C bus between hops. Every channel's DDC LO word
+ * and tuner registers are worked out before the first hop so a hop is
+ * one SPI write on HF or one I2C transaction on VHF. Hop timing is by
+ * absolute deadlines from the start of the hop: the settle time covers
+ * the bus write plus the audio path catching up, then the input power of
+ * receiver 0 is averaged over the dwell window and compared with the
+ * squelch.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "scan.h"
+#include "audio.h"
+#include "rxadc.h"
+#include "hwq.h"
+
+const char *scan_mode_names[] =
+{
+	"stop",
+	"log",
+};
+
+/* channel list & settings - only changed while no scan is running */
+static uint32_t scan_list[SCAN_MAX_CH];
+static scan_ch scan_chans[SCAN_MAX_CH];
+static int scan_num, scan_next;
+static uint32_t scan_settle_ms = SCAN_SETTLE_MS;
+static uint32_t scan_dwell_ms = SCAN_DWELL_MS;
+static float32_t scan_squelch = SCAN_SQUELCH_DB;
+static uint8_t scan_mode = SCAN_MODE_STOP;
+static int scan_vhf;
+
+/* run state */
+static volatile int scan_run;
+static int scan_busy;
+static void (*scan_done_cb)(void);
+static volatile uint32_t scan_cur;
+
+/* hits - written by the worker, read by the control thread */
+static scan_hit scan_hits[SCAN_MAX_HITS];
+static atomic_uint scan_hit_head;
+static unsigned int scan_hit_tail;
+
+/* hop timing for the last scan */
+static unsigned long scan_hops, scan_passes, scan_overruns;
+static uint64_t scan_ns, scan_bus_ns, scan_bus_max_ns;
+
+/*
+ * monotonic time in ns
+ */
+static uint64_t scan_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * sleep until a monotonic deadline in ns
+ */
+static void scan_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+/*
+ * add one channel - returns 1 if the list is full
+ */
+int scan_add(uint32_t freq)
+{
+	if(scan_busy || scan_num >= SCAN_MAX_CH)
+		return 1;
+	scan_list[scan_num++] = freq;
+	return 0;
+}
+
+/*
+ * add channels start..stop inclusive - returns 1 if they didn't all fit
+ */
+int scan_range(uint32_t start, uint32_t stop, uint32_t step)
+{
+	uint64_t f;
+
+	if(!step || stop < start)
+		return 1;
+	for(f=start;f<=stop;f+=step)
+		if(scan_add(f))
+			return 1;
+	return 0;
+}
+
+/*
+ * empty the channel list
+ */
+void scan_clear(void)
+{
+	if(scan_busy)
+		return;
+	scan_num = 0;
+	scan_next = 0;
+}
+
+int scan_channels(void)
+{
+	return scan_num;
+}
+
+void scan_set_time(uint32_t settle_ms, uint32_t dwell_ms)
+{
+	scan_settle_ms = settle_ms;
+	scan_dwell_ms = dwell_ms ? dwell_ms : 1;
+}
+
+void scan_set_squelch(float32_t db)
+{
+	scan_squelch = db;
+}
+
+void scan_set_mode(uint8_t mode)
+{
+	if(mode < SCAN_MODE_MAX)
+		scan_mode = mode;
+}
+
+/*
+ * work out the bus writes for every channel in the current front end mode,
+ * tuner plans come through the driver's cache
+ */
+static void scan_plan(void)
+{
+	int i;
+
+	scan_vhf = vhf;
+	for(i=0;i<scan_num;i++)
+	{
+		scan_chans[i].freq = scan_list[i];
+		if(scan_vhf)
+		{
+			scan_chans[i].plan = *R820T2_plan_get(scan_list[i]);
+			scan_chans[i].lo_raw = rxadc_lo_raw(R820T2_plan_if(
+				&scan_chans[i].plan, scan_list[i]));
+		}
+		else
+			scan_chans[i].lo_raw = rxadc_lo_raw(scan_list[i]);
+	}
+}
+
+/*
+ * retune - the DDC LO write is elided by the shadow when it doesn't change
+ */
+static void scan_tune(const scan_ch *ch)
+{
+	if(scan_vhf)
+		R820T2_set_plan(&ch->plan);
+	rxadc_write_reg(RXADC_REG_LO, ch->lo_raw);
+}
+
+/*
+ * post a hit for the control thread, oldest are lost if it falls behind
+ */
+static void scan_post(uint32_t freq, float32_t db)
+{
+	unsigned int h = atomic_load_explicit(&scan_hit_head, memory_order_relaxed);
+	scan_hit *p = &scan_hits[h & (SCAN_MAX_HITS-1)];
+
+	p->freq = freq;
+	p->db = db;
+	p->pass = scan_passes;
+	atomic_store_explicit(&scan_hit_head, h+1, memory_order_release);
+}
+
+/*
+ * the scan - hwq worker thread
+ */
+static void scan_job(hwq_cmd *c)
+{
+	uint64_t t_start, t_hop, t_bus, settle, dwell;
+	audio_pwr a, b;
+	float32_t db;
+	const scan_ch *ch;
+
+	(void)c;
+	scan_plan();
+	settle = (uint64_t)scan_settle_ms * 1000000ULL;
+	dwell = (uint64_t)scan_dwell_ms * 1000000ULL;
+	t_start = scan_now();
+	while(scan_run)
+	{
+		ch = &scan_chans[scan_next];
+		scan_cur = ch->freq;
+
+		/* hop */
+		t_hop = scan_now();
+		scan_tune(ch);
+		t_bus = scan_now() - t_hop;
+		scan_bus_ns += t_bus;
+		if(t_bus > scan_bus_max_ns)
+			scan_bus_max_ns = t_bus;
+		if(t_bus > settle)
+			scan_overruns++;
+		scan_hops++;
+
+		/* settle, then average over the dwell */
+		scan_sleep_until(t_hop + settle);
+		Audio_RxGetPower(0, &a);
+		scan_sleep_until(t_hop + settle + dwell);
+		Audio_RxGetPower(0, &b);
+		db = Audio_PowerDB(&a, &b);
+
+		/* next channel */
+		if(++scan_next >= scan_num)
+		{
+			scan_next = 0;
+			scan_passes++;
+		}
+
+		/* squelch */
+		if(db >= scan_squelch)
+		{
+			scan_post(ch->freq, db);
+			if(scan_mode == SCAN_MODE_STOP)
+				break;
+		}
+	}
+	scan_ns += scan_now() - t_start;
+}
+
+/*
+ * scan finished - control thread
+ */
+static void scan_finish(hwq_cmd *c)
+{
+	(void)c;
+	scan_busy = 0;
+	scan_run = 0;
+	if(scan_done_cb)
+		scan_done_cb();
+}
+
+/*
+ * start scanning from where the last scan stopped, done() is called on
+ * the control thread when it stops. Needs the hwq worker - inline it
+ * would never return.
+ */
+int scan_start(void (*done)(void))
+{
+	hwq_cmd *c;
+
+	if(scan_busy || !scan_num || !hwq_async())
+		return 1;
+	if((c = hwq_alloc()) == NULL)
+		return 1;
+
+	if(scan_next >= scan_num)
+		scan_next = 0;
+	scan_hops = scan_passes = scan_overruns = 0;
+	scan_ns = scan_bus_ns = scan_bus_max_ns = 0;
+	scan_done_cb = done;
+	scan_busy = 1;
+	scan_run = 1;
+
+	c->run = scan_job;
+	c->done = scan_finish;
+	hwq_submit(c);
+	return 0;
+}
+
+/*
+ * stop after the current hop
+ */
+void scan_stop(void)
+{
+	scan_run = 0;
+}
+
+int scan_active(void)
+{
+	return scan_busy;
+}
+
+/*
+ * next unreported hit - returns 0 when there are none
+ */
+int scan_get_hit(scan_hit *h)
+{
+	unsigned int head = atomic_load_explicit(&scan_hit_head, memory_order_acquire);
+
+	if(head - scan_hit_tail > SCAN_MAX_HITS)
+		scan_hit_tail = head - SCAN_MAX_HITS;
+	if(scan_hit_tail == head)
+		return 0;
+	*h = scan_hits[scan_hit_tail++ & (SCAN_MAX_HITS-1)];
+	return 1;
+}
+
+/*
+ * channel being listened to
+ */
+uint32_t scan_freq(void)
+{
+	return scan_cur;
+}
+
+/*
+ * settings & hop rate
+ */
+void scan_report(FILE *fd)
+{
+	float32_t s = scan_ns * 1e-9F;
+
+	fprintf(fd, "scan: %s, %d channels, %s, settle %u ms, dwell %u ms, squelch %.1f dB, mode %s\n",
+		scan_busy ? "running" : "idle", scan_num, vhf ? "VHF" : "HF",
+		scan_settle_ms, scan_dwell_ms, scan_squelch, scan_mode_names[scan_mode]);
+	if(scan_busy)
+		fprintf(fd, "scan: on %u Hz\n", scan_cur);
+	else if(scan_hops)
+		fprintf(fd, "scan: %lu hops, %lu passes, %.1f hops/s, retune avg %.1f us, max %.1f us, %lu overruns\n",
+			scan_hops, scan_passes, s > 0.0F ? scan_hops / s : 0.0F,
+			scan_bus_ns * 1e-3F / scan_hops, scan_bus_max_ns * 1e-3F,
+			scan_overruns);
+}
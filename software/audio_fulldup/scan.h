@@ -0,0 +1,64 @@
+/*
+ * scan.h - frequency hopping scanner
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __scan__
+#define __scan__
+
+#include "main.h"
+#include "r820t2.h"
+
+/* channel list size */
+#define SCAN_MAX_CH 256
+
+/* hits kept for the control thread to report - power of 2 */
+#define SCAN_MAX_HITS 64
+
+/* default timing after each hop, ms */
+#define SCAN_SETTLE_MS 30
+#define SCAN_DWELL_MS 50
+
+/* default squelch, dB on the RSSI scale */
+#define SCAN_SQUELCH_DB -60.0F
+
+enum scan_modes
+{
+	SCAN_MODE_STOP,		/* stay on the first open channel */
+	SCAN_MODE_LOG,		/* note it & keep going */
+	SCAN_MODE_MAX
+};
+
+/* everything a hop needs, worked out before the scan starts */
+typedef struct
+{
+	uint32_t freq;
+	uint32_t lo_raw;		/* DDC LO register */
+	r820t_plan plan;		/* tuner registers - VHF only */
+} scan_ch;
+
+/* channel that opened the squelch */
+typedef struct
+{
+	uint32_t freq;
+	float32_t db;
+	uint32_t pass;
+} scan_hit;
+
+extern const char *scan_mode_names[SCAN_MODE_MAX];
+
+int scan_add(uint32_t freq);
+int scan_range(uint32_t start, uint32_t stop, uint32_t step);
+void scan_clear(void);
+int scan_channels(void);
+void scan_set_time(uint32_t settle_ms, uint32_t dwell_ms);
+void scan_set_squelch(float32_t db);
+void scan_set_mode(uint8_t mode);
+int scan_start(void (*done)(void));
+void scan_stop(void);
+int scan_active(void);
+int scan_get_hit(scan_hit *h);
+uint32_t scan_freq(void);
+void scan_report(FILE *fd);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * spec.c - spectrum for the tune screen
+ * 10-16-26 E. Brombaugh
+ *
+ * A low priority thread takes the latest I/Q from the audio thread's
+ * snapshot buffer at the update rate, windows & FFTs it, averages the
+ * power and boils it down to one dB value per screen column. Results
+ * go out through a triple buffer so neither side ever waits: the
+ * thread always has a buffer to fill and the screen always has the
+ * newest complete one to read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "spec.h"
+#include "audio.h"
+#include "fft.h"
+
+/* triple buffer index flag - middle buffer is newer than the front */
+#define SPEC_FRESH 4
+
+/* settings - picked up by spec_start() */
+static int spec_fft_n = SPEC_FFT_N, spec_rate_hz = SPEC_RATE_HZ;
+static int spec_avg = SPEC_AVG;
+
+/* FFT thread */
+static pthread_t spec_thread;
+static volatile int spec_run;
+static int spec_active, spec_n, spec_cols;
+static fft_plan spec_fft;
+static float32_t *spec_win, *spec_re, *spec_im, *spec_pwr;
+static int16_t *spec_iq;
+
+/* display columns */
+static float32_t spec_tb[3][SPEC_MAX_COLS];
+static atomic_int spec_mid;
+static int spec_back, spec_front;
+
+/* timing */
+static unsigned long spec_updates, spec_retries;
+static uint64_t spec_fft_ns, spec_fft_max_ns;
+
+/*
+ * monotonic time in ns
+ */
+static uint64_t spec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * one update - FFT of the latest I/Q, average & reduce to columns
+ */
+static void spec_update(int first)
+{
+	float32_t *col = spec_tb[spec_back], k = 1.0F / spec_avg, p;
+	int i, c, s, s0, s1, n = spec_n;
+
+	for(i=0;i<n;i++)
+	{
+		spec_re[i] = spec_iq[2*i] * spec_win[i];
+		spec_im[i] = spec_iq[2*i+1] * spec_win[i];
+	}
+	fft_run(&spec_fft, spec_re, spec_im, 0);
+
+	for(i=0;i<n;i++)
+	{
+		p = spec_re[i]*spec_re[i] + spec_im[i]*spec_im[i];
+		spec_pwr[i] = first ? p : spec_pwr[i] + k*(p - spec_pwr[i]);
+	}
+
+	/* peak of the bins under each column, lowest frequency on the left */
+	for(c=0;c<spec_cols;c++)
+	{
+		s0 = c*n/spec_cols;
+		s1 = (c+1)*n/spec_cols;
+		s1 = s1 > s0 ? s1 : s0+1;
+		p = 0.0F;
+		for(s=s0;s<s1;s++)
+		{
+			i = (s + n/2) & (n-1);
+			p = spec_pwr[i] > p ? spec_pwr[i] : p;
+		}
+		col[c] = 10.0F*log10f(p + 1e-20F);
+	}
+
+	spec_back = atomic_exchange(&spec_mid, spec_back | SPEC_FRESH) & 3;
+}
+
+/*
+ * FFT thread
+ */
+static void *spec_worker(void *arg)
+{
+	struct timespec ts;
+	uint64_t t, period = 1000000000ULL / spec_rate_hz, next;
+	int first = 1;
+
+	(void)arg;
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), SPEC_NICE);
+
+	next = spec_now();
+	while(spec_run)
+	{
+		next += period;
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		/* overwritten mid copy - once more, else skip this update */
+		if(Audio_Snapshot(spec_iq, spec_n))
+		{
+			spec_retries++;
+			if(Audio_Snapshot(spec_iq, spec_n))
+				continue;
+		}
+
+		t = spec_now();
+		spec_update(first);
+		first = 0;
+		t = spec_now() - t;
+		spec_fft_ns += t;
+		if(t > spec_fft_max_ns)
+			spec_fft_max_ns = t;
+		spec_updates++;
+	}
+
+	return NULL;
+}
+
+/*
+ * release the FFT & buffers
+ */
+static void spec_free(void)
+{
+	fft_free(&spec_fft);
+	free(spec_win);
+	free(spec_re);
+	free(spec_im);
+	free(spec_pwr);
+	free(spec_iq);
+	spec_win = spec_re = spec_im = spec_pwr = NULL;
+	spec_iq = NULL;
+}
+
+/*
+ * start the FFT thread for a display cols wide
+ */
+int spec_start(int cols)
+{
+	float32_t sum = 0.0F;
+	int i, n = spec_fft_n;
+
+	if(spec_active)
+		return 0;
+
+	if(fft_init(&spec_fft, n))
+		return 1;
+	spec_win = (float32_t *)malloc(n * sizeof(float32_t));
+	spec_re = (float32_t *)malloc(n * sizeof(float32_t));
+	spec_im = (float32_t *)malloc(n * sizeof(float32_t));
+	spec_pwr = (float32_t *)malloc(n * sizeof(float32_t));
+	spec_iq = (int16_t *)malloc(2 * n * sizeof(int16_t));
+	if(!spec_win || !spec_re || !spec_im || !spec_pwr || !spec_iq)
+	{
+		spec_free();
+		return 1;
+	}
+
+	/* Hann, full scale tone at 0dBFS */
+	for(i=0;i<n;i++)
+	{
+		spec_win[i] = 0.5F - 0.5F*cosf(2.0F*PI*i/n);
+		sum += spec_win[i];
+	}
+	for(i=0;i<n;i++)
+		spec_win[i] /= 32768.0F * sum;
+
+	spec_n = n;
+	spec_cols = cols < 1 ? 1 : cols > SPEC_MAX_COLS ? SPEC_MAX_COLS : cols;
+	spec_back = 0;
+	spec_front = 1;
+	atomic_store(&spec_mid, 2);
+	spec_updates = spec_retries = 0;
+	spec_fft_ns = spec_fft_max_ns = 0;
+
+	Audio_SnapEnable(1);
+	spec_run = 1;
+	if(pthread_create(&spec_thread, NULL, spec_worker, NULL))
+	{
+		fprintf(stderr, "spec_start: can't start thread\n");
+		Audio_SnapEnable(0);
+		spec_free();
+		return 1;
+	}
+	spec_active = 1;
+	return 0;
+}
+
+/*
+ * stop the thread
+ */
+void spec_stop(void)
+{
+	if(!spec_active)
+		return;
+
+	spec_run = 0;
+	pthread_join(spec_thread, NULL);
+	Audio_SnapEnable(0);
+	spec_free();
+	spec_active = 0;
+}
+
+int spec_running(void)
+{
+	return spec_active;
+}
+
+/*
+ * newest columns into db - returns 0 if nothing new since last time
+ */
+int spec_get(float32_t *db)
+{
+	if(!spec_active || !(atomic_load(&spec_mid) & SPEC_FRESH))
+		return 0;
+	spec_front = atomic_exchange(&spec_mid, spec_front) & 3;
+	memcpy(db, spec_tb[spec_front], spec_cols * sizeof(float32_t));
+	return 1;
+}
+
+/*
+ * settings - take effect at the next spec_start(), return 1 if invalid
+ */
+int spec_set_fft(int n)
+{
+	if(n < SPEC_FFT_MIN || n > SPEC_FFT_MAX || (n & (n-1)))
+		return 1;
+	spec_fft_n = n;
+	return 0;
+}
+
+int spec_set_rate(int hz)
+{
+	if(hz < 1 || hz > SPEC_RATE_MAX)
+		return 1;
+	spec_rate_hz = hz;
+	return 0;
+}
+
+int spec_set_avg(int avg)
+{
+	if(avg < 1 || avg > SPEC_AVG_MAX)
+		return 1;
+	spec_avg = avg;
+	return 0;
+}
+
+/*
+ * settings & FFT thread load
+ */
+void spec_report(FILE *fd)
+{
+	fprintf(fd, "spec: %s, %d point FFT, %d Hz, average %d\n",
+		spec_active ? "running" : "idle", spec_fft_n, spec_rate_hz, spec_avg);
+	if(spec_updates)
+		fprintf(fd, "spec: %lu updates, fft avg %.1f us, max %.1f us, %lu retries\n",
+			spec_updates, spec_fft_ns * 1e-3F / spec_updates,
+			spec_fft_max_ns * 1e-3F, spec_retries);
+}
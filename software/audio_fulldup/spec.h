@@ -0,0 +1,39 @@
+/*
+ * spec.h - spectrum for the tune screen
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __spec__
+#define __spec__
+
+#include "main.h"
+
+/* FFT size - power of 2 */
+#define SPEC_FFT_N 512
+#define SPEC_FFT_MIN 64
+#define SPEC_FFT_MAX 4096
+
+/* updates per second */
+#define SPEC_RATE_HZ 10
+#define SPEC_RATE_MAX 50
+
+/* power averaging, FFTs */
+#define SPEC_AVG 4
+#define SPEC_AVG_MAX 64
+
+/* widest display */
+#define SPEC_MAX_COLS 256
+
+/* the FFT thread runs below everything else */
+#define SPEC_NICE 10
+
+int spec_start(int cols);
+void spec_stop(void);
+int spec_running(void);
+int spec_get(float32_t *db);
+int spec_set_fft(int n);
+int spec_set_rate(int hz);
+int spec_set_avg(int avg);
+void spec_report(FILE *fd);
+
+#endif
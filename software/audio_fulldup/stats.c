@@ -0,0 +1,165 @@
+/*
+ * stats.c - audio path instrumentation
+ * 10-16-26 E. Brombaugh
+ *
+ * Audio_Process() charges its stages with stats_mark() and hands the
+ * period total to stats_period(). The ALSA paths count their errors
+ * with stats_pcm_err(). Everything is plain counters so the hot path
+ * costs a few clock reads per block.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "main.h"
+#include "stats.h"
+
+/* smoothing for averages - roughly the last 100 periods */
+#define STATS_ALPHA 0.01F
+
+audio_stats stats;
+
+const char *stats_stage_names[STAGE_MAX] =
+{
+	"convert",
+	"dcblock",
+	"filter",
+	"agc",
+	"demod",
+	"output",
+};
+
+const char *stats_dir_names[STATS_DIRS] =
+{
+	"capture",
+	"playback",
+};
+
+/*
+ * clear everything
+ */
+void stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * end of a DSP period - update averages & histogram
+ */
+void stats_period(int frames, uint64_t ns)
+{
+	float us = (float)ns * 1e-3F, period_us, a;
+	uint64_t whole_us = ns / 1000;
+	int i, bin;
+
+	if(frames <= 0)
+		return;
+
+	/* first period seeds the averages */
+	a = stats.periods ? STATS_ALPHA : 1.0F;
+	stats.periods++;
+	stats.frames += frames;
+
+	/* time per period */
+	stats.last_us = us;
+	stats.avg_us += a * (us - stats.avg_us);
+	if(us > stats.max_us)
+		stats.max_us = us;
+
+	/* against the real time budget */
+	period_us = (float)frames * 1e6F / (float)sample_rate;
+	if(us > period_us)
+		stats.overruns++;
+	stats.load += a * (us / period_us - stats.load);
+
+	/* log2 histogram */
+	for(bin=0;bin<STATS_HIST_BINS-1;bin++)
+		if(whole_us < (2ULL << bin))
+			break;
+	stats.hist[bin]++;
+
+	/* per-stage ns / frame */
+	for(i=0;i<STAGE_MAX;i++)
+	{
+		stats.stage_ns[i] += a * ((float)stats.stage_acc[i] / frames -
+			stats.stage_ns[i]);
+		stats.stage_acc[i] = 0;
+	}
+}
+
+/*
+ * count a PCM error by kind
+ */
+void stats_pcm_err(int dir, int err)
+{
+	stats_pcm *p = &stats.pcm[dir];
+
+	if(err == -EPIPE)
+		p->xruns++;
+	else if(err == -ESTRPIPE)
+		p->suspends++;
+	else
+		p->errors++;
+}
+
+/*
+ * measured capture to playback delay in frames, from the I/O thread
+ */
+void stats_latency(long frames)
+{
+	float ms = (float)frames * 1000.0F / (float)sample_rate;
+
+	stats.lat_ms = ms;
+	stats.lat_avg_ms += (stats.lat_count++ ? STATS_ALPHA : 1.0F) *
+		(ms - stats.lat_avg_ms);
+	if(ms > stats.lat_max_ms)
+		stats.lat_max_ms = ms;
+}
+
+/*
+ * full report
+ */
+void stats_report(FILE *f)
+{
+	stats_pcm *p;
+	int i;
+
+	fprintf(f, "DSP: %lu periods, %lu frames, %lu overruns\n",
+		stats.periods, stats.frames, stats.overruns);
+	fprintf(f, "     last %.1f us  avg %.1f us  max %.1f us  load %.1f%%\n",
+		stats.last_us, stats.avg_us, stats.max_us, 100.0F * stats.load);
+
+	fprintf(f, "stage ns/frame:");
+	for(i=0;i<STAGE_MAX;i++)
+		fprintf(f, " %s %.1f", stats_stage_names[i], stats.stage_ns[i]);
+	fprintf(f, "\n");
+
+	/* skip empty bins */
+	fprintf(f, "DSP time/period histogram:\n");
+	for(i=0;i<STATS_HIST_BINS;i++)
+		if(stats.hist[i])
+			fprintf(f, "  %s%6u us: %lu\n", i == STATS_HIST_BINS-1 ? ">=" : "< ",
+				i == STATS_HIST_BINS-1 ? 1U << i : 2U << i, stats.hist[i]);
+
+	for(i=0;i<STATS_DIRS;i++)
+	{
+		p = &stats.pcm[i];
+		fprintf(f, "%s: xruns %lu  suspends %lu  errors %lu  recovers %lu  failed %lu  short %lu\n",
+			stats_dir_names[i], p->xruns, p->suspends, p->errors,
+			p->recovers, p->recover_fails, p->shorts);
+	}
+
+	if(stats.lat_count)
+		fprintf(f, "latency: last %.1f ms  avg %.1f ms  max %.1f ms\n",
+			stats.lat_ms, stats.lat_avg_ms, stats.lat_max_ms);
+}
+
+/*
+ * one line summary for the tune screen
+ */
+void stats_line(char *buf, int len)
+{
+	snprintf(buf, len, "DSP: %6.1f/%6.1f us  load %5.1f%%  xrun c:%lu p:%lu  ovr: %lu  ",
+		stats.avg_us, stats.max_us, 100.0F * stats.load,
+		stats.pcm[STATS_CAPTURE].xruns, stats.pcm[STATS_PLAYBACK].xruns,
+		stats.overruns);
+}
@@ -0,0 +1,104 @@
+/*
+ * stats.h - audio path instrumentation
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __stats__
+#define __stats__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* DSP stages timed inside Audio_Process() */
+enum stats_stages
+{
+	STAGE_CONVERT,
+	STAGE_DCBLOCK,
+	STAGE_FILTER,
+	STAGE_AGC,
+	STAGE_DEMOD,
+	STAGE_OUTPUT,
+	STAGE_MAX
+};
+
+/* PCM directions */
+enum stats_dirs
+{
+	STATS_CAPTURE,
+	STATS_PLAYBACK,
+	STATS_DIRS
+};
+
+/* DSP time per period histogram - bin n holds [2^n, 2^(n+1)) us */
+#define STATS_HIST_BINS 16
+
+/* PCM error counters */
+typedef struct
+{
+	unsigned long xruns;			/* -EPIPE */
+	unsigned long suspends;			/* -ESTRPIPE */
+	unsigned long errors;			/* anything else */
+	unsigned long recovers;			/* successful snd_pcm_recover() */
+	unsigned long recover_fails;
+	unsigned long shorts;			/* short reads / writes */
+} stats_pcm;
+
+/*
+ * Each field has a single writer - DSP fields are owned by whichever
+ * thread runs Audio_Process(), PCM fields by the thread doing that I/O.
+ * Readers just take a look, a torn value only ever affects a report.
+ */
+typedef struct
+{
+	/* DSP */
+	unsigned long periods;
+	unsigned long frames;
+	unsigned long overruns;			/* periods where DSP took > real time */
+	unsigned long hist[STATS_HIST_BINS];
+	float last_us, avg_us, max_us;
+	float load;						/* smoothed DSP time / period time */
+	float stage_ns[STAGE_MAX];		/* smoothed ns per frame */
+	uint64_t stage_acc[STAGE_MAX];	/* ns in the current period */
+
+	/* PCM */
+	stats_pcm pcm[STATS_DIRS];
+
+	/* capture to playback latency */
+	unsigned long lat_count;
+	float lat_ms, lat_avg_ms, lat_max_ms;
+} audio_stats;
+
+extern audio_stats stats;
+extern const char *stats_stage_names[STAGE_MAX];
+
+/*
+ * monotonic time in ns
+ */
+static inline uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * charge the time since *t to a stage & restart the clock
+ */
+static inline void stats_mark(int stage, uint64_t *t)
+{
+	uint64_t now = stats_now();
+
+	stats.stage_acc[stage] += now - *t;
+	*t = now;
+}
+
+void stats_reset(void);
+void stats_period(int frames, uint64_t ns);
+void stats_pcm_err(int dir, int err);
+void stats_latency(long frames);
+void stats_report(FILE *f);
+void stats_line(char *buf, int len);
+
+#endif
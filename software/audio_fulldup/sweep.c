@@ -0,0 +1,390 @@
+/*
+ * sweep.c - wideband spectrum sweep
+ * 10-16-26 E. Brombaugh
+ *
+ * Steps the DDC LO (HF) or the R820T2 (VHF) across a span, grabs a block
+ * of raw I/Q from the audio thread at each step, windows & FFTs it and
+ * keeps the middle of the band where the decimation filters are flat.
+ * The kept bins are laid end to end into one power spectrum that goes
+ * to a file when the sweep is done.
+ *
+ * Like the scanner the sweep is one long job on the hwq worker. As soon
+ * as a block is captured the next retune goes out and the FFT of that
+ * block runs while the front end settles, so the step rate is set by
+ * the bus, settle & capture times rather than the CPU.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sweep.h"
+#include "audio.h"
+#include "fft.h"
+#include "rxadc.h"
+#include "r820t2.h"
+#include "hwq.h"
+
+/* FFT & buffers for the current size */
+static int sweep_n = SWEEP_FFT_N, sweep_alloc_n;
+static fft_plan sweep_fft;
+static float32_t *sweep_win, *sweep_re, *sweep_im;
+static int16_t *sweep_cap;
+static uint32_t sweep_settle_ms = SWEEP_SETTLE_MS;
+
+/* the sweep in progress */
+static uint32_t sweep_start_hz;
+static int sweep_steps, sweep_keep, sweep_vhf;
+static double sweep_bin_hz, sweep_step_hz;
+static float32_t *sweep_pan;
+static char sweep_file[256];
+
+/* run state */
+static volatile int sweep_run;
+static int sweep_busy, sweep_err;
+static void (*sweep_done_cb)(int err);
+
+/* timing for the last sweep */
+static int sweep_done_steps;
+static unsigned long sweep_late;
+static uint64_t sweep_ns, sweep_cap_ns, sweep_fft_ns, sweep_bus_ns;
+
+static const char *sweep_err_names[] =
+{
+	"done",
+	"no I/Q from the audio thread",
+	"can't write file",
+	"stopped",
+};
+
+/*
+ * monotonic time in ns
+ */
+static uint64_t sweep_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * sleep until a monotonic deadline in ns
+ */
+static void sweep_sleep_until(uint64_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+/*
+ * release the FFT & buffers
+ */
+static void sweep_free(void)
+{
+	fft_free(&sweep_fft);
+	free(sweep_win);
+	free(sweep_re);
+	free(sweep_im);
+	free(sweep_cap);
+	sweep_win = sweep_re = sweep_im = NULL;
+	sweep_cap = NULL;
+	sweep_alloc_n = 0;
+}
+
+/*
+ * FFT, buffers & window for n points. The window is scaled so a full
+ * scale complex tone in the middle of a bin comes out at 0dBFS.
+ */
+static int sweep_alloc(int n)
+{
+	float32_t sum = 0.0F;
+	int i;
+
+	if(sweep_alloc_n == n)
+		return 0;
+	sweep_free();
+
+	if(fft_init(&sweep_fft, n))
+		return 1;
+	sweep_win = (float32_t *)malloc(n * sizeof(float32_t));
+	sweep_re = (float32_t *)malloc(n * sizeof(float32_t));
+	sweep_im = (float32_t *)malloc(n * sizeof(float32_t));
+	sweep_cap = (int16_t *)malloc(2 * n * sizeof(int16_t));
+	if(!sweep_win || !sweep_re || !sweep_im || !sweep_cap)
+	{
+		sweep_free();
+		return 1;
+	}
+
+	/* Hann */
+	for(i=0;i<n;i++)
+	{
+		sweep_win[i] = 0.5F - 0.5F*cosf(2.0F*PI*i/n);
+		sum += sweep_win[i];
+	}
+	for(i=0;i<n;i++)
+		sweep_win[i] /= 32768.0F * sum;
+
+	sweep_alloc_n = n;
+	return 0;
+}
+
+/*
+ * FFT size for the next sweep - returns 1 if it's not a power of 2 in range
+ */
+int sweep_set_fft(int n)
+{
+	if(sweep_busy || n < SWEEP_FFT_MIN || n > SWEEP_FFT_MAX || (n & (n-1)))
+		return 1;
+	sweep_n = n;
+	return 0;
+}
+
+void sweep_set_settle(uint32_t ms)
+{
+	sweep_settle_ms = ms;
+}
+
+/*
+ * retune to step k - centered so its first kept bin follows on from the
+ * last one of step k-1. Worked out in double, float32 is 128Hz coarse
+ * at 1GHz. The tuner plan is for f rounded to r820t_plan_step, the DDC
+ * takes up the difference.
+ */
+static void sweep_tune(int k)
+{
+	uint32_t f = sweep_start_hz + sweep_step_hz*k + sweep_bin_hz*(sweep_keep/2) + 0.5;
+	const r820t_plan *p;
+
+	if(sweep_vhf)
+	{
+		p = R820T2_plan_get(f);
+		R820T2_set_plan(p);
+		rxadc_write_reg(RXADC_REG_LO, rxadc_lo_raw(R820T2_plan_if(p, f)));
+	}
+	else
+		rxadc_write_reg(RXADC_REG_LO, rxadc_lo_raw(f));
+}
+
+/*
+ * power spectrum of the captured block into the panorama. The R820T2
+ * LO sits above the signal so the spectrum at the IF is upside down.
+ */
+static void sweep_spectrum(int k)
+{
+	float32_t *out = &sweep_pan[k*sweep_keep], p;
+	int i, j, o, n = sweep_n, half = sweep_keep/2;
+
+	for(i=0;i<n;i++)
+	{
+		sweep_re[i] = sweep_cap[2*i] * sweep_win[i];
+		sweep_im[i] = sweep_cap[2*i+1] * sweep_win[i];
+	}
+	fft_run(&sweep_fft, sweep_re, sweep_im, 0);
+
+	for(j=0;j<sweep_keep;j++)
+	{
+		o = sweep_vhf ? half - j : j - half;
+		i = o & (n-1);
+		p = sweep_re[i]*sweep_re[i] + sweep_im[i]*sweep_im[i];
+		out[j] = 10.0F*log10f(p + 1e-20F);
+	}
+
+	/* DC bin holds the DDC's own offset - fill it from its neighbours */
+	out[half] = 0.5F*(out[half-1] + out[half+1]);
+}
+
+/*
+ * write the panorama - CSV for a .csv file, binary otherwise
+ */
+static int sweep_write(void)
+{
+	FILE *fd;
+	sweep_hdr h;
+	int i, bins = sweep_steps*sweep_keep, len = strlen(sweep_file), ret = 0;
+
+	if((fd = fopen(sweep_file, "w")) == NULL)
+		return 1;
+
+	if(len > 4 && strcmp(&sweep_file[len-4], ".csv") == 0)
+	{
+		fprintf(fd, "freq_hz,dbfs\n");
+		for(i=0;i<bins;i++)
+			fprintf(fd, "%.1f,%.2f\n",
+				sweep_start_hz + (double)i*sweep_bin_hz, sweep_pan[i]);
+	}
+	else
+	{
+		h.magic = SWEEP_MAGIC;
+		h.bins = bins;
+		h.start_hz = sweep_start_hz;
+		h.bin_hz = sweep_bin_hz;
+		if(fwrite(&h, sizeof(h), 1, fd) != 1 ||
+			fwrite(sweep_pan, sizeof(float32_t), bins, fd) != (size_t)bins)
+			ret = 1;
+	}
+
+	if(fclose(fd))
+		ret = 1;
+	return ret;
+}
+
+/*
+ * the sweep - hwq worker thread
+ */
+static void sweep_job(hwq_cmd *c)
+{
+	uint64_t t_start, t_hop, t, settle;
+	int k;
+
+	(void)c;
+	settle = (uint64_t)sweep_settle_ms * 1000000ULL;
+	t_start = t_hop = sweep_now();
+	sweep_tune(0);
+	sweep_bus_ns += sweep_now() - t_hop;
+
+	for(k=0;k<sweep_steps;k++)
+	{
+		if(!sweep_run)
+		{
+			sweep_err = 3;
+			break;
+		}
+
+		/* settle, then grab a block */
+		sweep_sleep_until(t_hop + settle);
+		t = sweep_now();
+		Audio_CaptureStart(sweep_cap, sweep_n);
+		if(Audio_CaptureWait(SWEEP_CAP_TIMEOUT_MS))
+		{
+			sweep_err = 1;
+			break;
+		}
+		sweep_cap_ns += sweep_now() - t;
+
+		/* next step settles while this one is crunched */
+		if(k+1 < sweep_steps)
+		{
+			t_hop = sweep_now();
+			sweep_tune(k+1);
+			sweep_bus_ns += sweep_now() - t_hop;
+		}
+
+		t = sweep_now();
+		sweep_spectrum(k);
+		sweep_fft_ns += sweep_now() - t;
+		if(k+1 < sweep_steps && sweep_now() > t_hop + settle)
+			sweep_late++;
+		sweep_done_steps++;
+	}
+
+	if(!sweep_err && sweep_write())
+		sweep_err = 2;
+	sweep_ns = sweep_now() - t_start;
+}
+
+/*
+ * sweep finished - control thread
+ */
+static void sweep_finish(hwq_cmd *c)
+{
+	(void)c;
+	sweep_busy = 0;
+	sweep_run = 0;
+	if(sweep_done_cb)
+		sweep_done_cb(sweep_err);
+}
+
+/*
+ * sweep start..stop Hz into file, done() is called on the control
+ * thread with 0 or an error code when it's finished
+ */
+int sweep_start(uint32_t start, uint32_t stop, const char *file,
+	void (*done)(int err))
+{
+	hwq_cmd *c;
+	double sr = sample_rate * 12.5 / 12.0;
+	int steps, keep;
+
+	if(sweep_busy || stop <= start || !hwq_async())
+		return 1;
+
+	/* step is the kept part of the DDC band */
+	keep = (sweep_n * SWEEP_KEEP_PCT / 100) & ~1;
+	steps = ceil((stop - start) / (keep * sr / sweep_n));
+	if(steps > SWEEP_MAX_STEPS)
+	{
+		fprintf(stderr, "sweep_start: %d steps, max %d\n", steps, SWEEP_MAX_STEPS);
+		return 1;
+	}
+	if(sweep_alloc(sweep_n))
+	{
+		fprintf(stderr, "sweep_start: can't set up %d point FFT\n", sweep_n);
+		return 1;
+	}
+	free(sweep_pan);
+	if((sweep_pan = (float32_t *)malloc(steps * keep * sizeof(float32_t))) == NULL)
+	{
+		fprintf(stderr, "sweep_start: can't allocate %d bins\n", steps * keep);
+		return 1;
+	}
+	if((c = hwq_alloc()) == NULL)
+		return 1;
+
+	sweep_start_hz = start;
+	sweep_steps = steps;
+	sweep_keep = keep;
+	sweep_bin_hz = sr / sweep_n;
+	sweep_step_hz = keep * sweep_bin_hz;
+	sweep_vhf = vhf;
+	snprintf(sweep_file, sizeof(sweep_file), "%s", file);
+
+	sweep_err = 0;
+	sweep_done_steps = 0;
+	sweep_late = 0;
+	sweep_ns = sweep_cap_ns = sweep_fft_ns = sweep_bus_ns = 0;
+	sweep_done_cb = done;
+	sweep_busy = 1;
+	sweep_run = 1;
+
+	c->run = sweep_job;
+	c->done = sweep_finish;
+	hwq_submit(c);
+	return 0;
+}
+
+/*
+ * abandon the sweep after the current step - nothing is written
+ */
+void sweep_stop(void)
+{
+	sweep_run = 0;
+}
+
+int sweep_active(void)
+{
+	return sweep_busy;
+}
+
+/*
+ * settings & step rate of the last sweep
+ */
+void sweep_report(FILE *fd)
+{
+	float32_t sr = sample_rate * 12.5F / 12.0F, s = sweep_ns * 1e-9F;
+	int keep = (sweep_n * SWEEP_KEEP_PCT / 100) & ~1, k = sweep_done_steps;
+
+	fprintf(fd, "sweep: %s, %d point FFT, %.1f Hz bins, %.0f Hz steps, settle %u ms\n",
+		sweep_busy ? "running" : "idle", sweep_n, sr / sweep_n,
+		keep * sr / sweep_n, sweep_settle_ms);
+	if(!sweep_busy && k)
+		fprintf(fd, "sweep: %s, %d of %d steps to %s, %.1f steps/s, capture %.2f ms, fft %.1f us, retune %.1f us, %lu late\n",
+			sweep_err_names[sweep_err], k, sweep_steps, sweep_file,
+			s > 0.0F ? k / s : 0.0F, sweep_cap_ns * 1e-6F / k,
+			sweep_fft_ns * 1e-3F / k, sweep_bus_ns * 1e-3F / k, sweep_late);
+}
@@ -0,0 +1,48 @@
+/*
+ * sweep.h - wideband spectrum sweep
+ * 10-16-26 E. Brombaugh
+ */
+
+#ifndef __sweep__
+#define __sweep__
+
+#include "main.h"
+
+/* FFT per step - power of 2 */
+#define SWEEP_FFT_N 1024
+#define SWEEP_FFT_MIN 64
+#define SWEEP_FFT_MAX 8192
+
+/* middle of each step kept, percent of the DDC bandwidth */
+#define SWEEP_KEEP_PCT 75
+
+/* after each retune, ms */
+#define SWEEP_SETTLE_MS 30
+
+/* longest sweep & how long to wait for the audio thread */
+#define SWEEP_MAX_STEPS 4096
+#define SWEEP_CAP_TIMEOUT_MS 1000
+
+/*
+ * binary output - header then bins float32 dBFS, all little endian on
+ * the Pi. A .csv file gets "freq_hz,dbfs" lines instead.
+ */
+#define SWEEP_MAGIC 0x31505753		/* "SWP1" */
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t bins;
+	double start_hz;
+	double bin_hz;
+} sweep_hdr;
+
+int sweep_start(uint32_t start, uint32_t stop, const char *file,
+	void (*done)(int err));
+void sweep_stop(void);
+int sweep_active(void);
+int sweep_set_fft(int n);
+void sweep_set_settle(uint32_t ms);
+void sweep_report(FILE *fd);
+
+#endif
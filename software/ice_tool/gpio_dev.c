@@ -11,6 +11,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/gpio.h>
@@ -19,6 +21,9 @@
 #define RPI_GPIODEV "gpiochip0"
 #define CONSUMER "gpio_dev"
 
+/* chip the lines are on - change before GPIOInit() for gpio-sim etc */
+const char *gpio_chip = RPI_GPIODEV;
+
 /**
  * gpiotools_request_linehandle() - request gpio lines in a gpiochip
  * @device_name:	The name of gpiochip without prefix "/dev/",
@@ -157,7 +162,96 @@ int gpiotools_release_linehandle(const int fd)
 	return ret;
 }
 
+/**
+ * gpiotools_request_lineevent() - request edge events on a gpio line
+ * @device_name:	The name of gpiochip without prefix "/dev/",
+ *			such as "gpiochip0"
+ * @line:		The line offset to watch.
+ * @handleflags:	Line flags, GPIOHANDLE_REQUEST_INPUT etc.
+ * @eventflags:		Edges to report, GPIOEVENT_REQUEST_BOTH_EDGES etc.
+ * @consumer_label:	The name of consumer.
+ *
+ * The returned fd becomes readable when an edge is queued, and also
+ * answers GPIOHANDLE_GET_LINE_VALUES_IOCTL for the line's level.
+ *
+ * Return:		On success return the fd;
+ *			On failure return the errno.
+ */
+int gpiotools_request_lineevent(const char *device_name, unsigned int line,
+				unsigned int handleflags, unsigned int eventflags,
+				const char *consumer_label)
+{
+	struct gpioevent_request req;
+	char *chrdev_name;
+	int fd;
+	int ret;
+
+	ret = asprintf(&chrdev_name, "/dev/%s", device_name);
+	if (ret < 0)
+		return -ENOMEM;
+
+	fd = open(chrdev_name, 0);
+	if (fd == -1) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open %s, %s\n",
+			chrdev_name, strerror(errno));
+		goto exit_close_error;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = line;
+	req.handleflags = handleflags;
+	req.eventflags = eventflags;
+	strcpy(req.consumer_label, consumer_label);
+
+	ret = ioctl(fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+	if (ret == -1) {
+		ret = -errno;
+		fprintf(stderr, "Failed to issue %s (%d), %s\n",
+			"GPIO_GET_LINEEVENT_IOCTL", ret, strerror(errno));
+	}
+
+exit_close_error:
+	if (close(fd) == -1)
+		perror("Failed to close GPIO character device file");
+	free(chrdev_name);
+	return ret < 0 ? ret : req.fd;
+}
+
+/**
+ * gpiotools_wait_event(): Wait for an edge on a lineevent fd
+ * @fd:			The fd returned by
+ *			gpiotools_request_lineevent().
+ * @timeout_ms:		How long to wait, -1 for ever, 0 to just check.
+ * @event:		The event read, if any.
+ *
+ * Return:		1 if an event was read, 0 on timeout;
+ *			On failure return the errno.
+ */
+int gpiotools_wait_event(const int fd, int timeout_ms,
+			 struct gpioevent_data *event)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int ret;
+
+	do
+		ret = poll(&pfd, 1, timeout_ms);
+	while (ret == -1 && errno == EINTR);
+	if (ret <= 0)
+		return ret ? -errno : 0;
+
+	ret = read(fd, event, sizeof(*event));
+	if (ret != sizeof(*event)) {
+		ret = ret == -1 ? -errno : -EIO;
+		fprintf(stderr, "Failed to read GPIO event (%d)\n", ret);
+		return ret;
+	}
+
+	return 1;
+}
+
 int gpio_out_fd, gpio_in_fd;
+int gpio_nin, gpio_event_fd[GPIOHANDLES_MAX];
 
 struct gpiohandle_data gpio_out_data, gpio_in_data;
 
@@ -170,17 +264,33 @@ int GPIOInit(int nout, unsigned int out_lines[], int nin, unsigned int in_lines[
 	memset(&gpio_out_data, 1, sizeof(struct gpiohandle_data));
 	
 	/* open output with default values */
-	gpio_out_fd = gpiotools_request_linehandle(RPI_GPIODEV, out_lines, 
+	gpio_out_fd = gpiotools_request_linehandle(gpio_chip, out_lines, 
 		nout, GPIOHANDLE_REQUEST_OUTPUT, &gpio_out_data, CONSUMER);
-	if(gpio_out_fd == -1)
+	if(gpio_out_fd < 0)
 	{
 		return 1;
 	}
 	
-	/* open input */
-	gpio_in_fd = gpiotools_request_linehandle(RPI_GPIODEV, in_lines, 
+	/* open inputs, one event fd each so edges can be waited on */
+	gpio_in_fd = -1;
+	for(gpio_nin=0;gpio_nin<nin;gpio_nin++)
+	{
+		gpio_event_fd[gpio_nin] = gpiotools_request_lineevent(gpio_chip,
+			in_lines[gpio_nin], GPIOHANDLE_REQUEST_INPUT,
+			GPIOEVENT_REQUEST_BOTH_EDGES, CONSUMER);
+		if(gpio_event_fd[gpio_nin] < 0)
+			break;
+	}
+	if(gpio_nin == nin)
+		return 0;
+	
+	/* no edge detect on these lines - fall back to polling a handle */
+	while(gpio_nin--)
+		gpiotools_release_linehandle(gpio_event_fd[gpio_nin]);
+	gpio_nin = 0;
+	gpio_in_fd = gpiotools_request_linehandle(gpio_chip, in_lines, 
 		nin, GPIOHANDLE_REQUEST_INPUT, &gpio_in_data, CONSUMER);
-	if(gpio_in_fd == -1)
+	if(gpio_in_fd < 0)
 	{
 		gpiotools_release_linehandle(gpio_out_fd);
 		return 1;
@@ -195,7 +305,10 @@ int GPIOInit(int nout, unsigned int out_lines[], int nin, unsigned int in_lines[
 void GPIOFree(void)
 {
 	gpiotools_release_linehandle(gpio_out_fd);
-	gpiotools_release_linehandle(gpio_in_fd);	
+	if(gpio_in_fd >= 0)
+		gpiotools_release_linehandle(gpio_in_fd);
+	while(gpio_nin)
+		gpiotools_release_linehandle(gpio_event_fd[--gpio_nin]);
 }
 
 /*
@@ -205,12 +318,82 @@ int GPIORead(int pin)
 {
 	int ret;
 	
+	if(gpio_in_fd < 0)
+	{
+		/* event fds report just their own line */
+		if((ret = gpiotools_get_values(gpio_event_fd[pin], &gpio_in_data)) < 0)
+			return ret;
+		return gpio_in_data.values[0];
+	}
+	
 	if((ret = gpiotools_get_values(gpio_in_fd, &gpio_in_data)) < 0)
 		return ret;
 	else
 		return gpio_in_data.values[pin];
 }
 
+/*
+ * ms since an earlier time
+ */
+static int gpio_elapsed_ms(struct timespec *t0)
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1000 +
+		(t.tv_nsec - t0->tv_nsec) / 1000000;
+}
+
+/*
+ * wait up to timeout_ms for an input to reach a level. Sleeps on edge
+ * events when the line has them, otherwise polls every 100us.
+ * returns 0 at the level, 1 on timeout, < 0 on error
+ */
+int GPIOWaitLevel(int pin, int value, int timeout_ms)
+{
+	struct gpioevent_data ev;
+	struct timespec t0;
+	int ret, left;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	
+	if(gpio_in_fd >= 0)
+	{
+		while((ret = GPIORead(pin)) != value)
+		{
+			if(ret < 0)
+				return ret;
+			if(gpio_elapsed_ms(&t0) >= timeout_ms)
+				return 1;
+			usleep(100);
+		}
+		return 0;
+	}
+	
+	/* drop stale edges - anything after this is queued by the kernel */
+	while((ret = gpiotools_wait_event(gpio_event_fd[pin], 0, &ev)) > 0);
+	if(ret < 0)
+		return ret;
+	
+	if((ret = GPIORead(pin)) != value)
+	{
+		if(ret < 0)
+			return ret;
+		do
+		{
+			left = timeout_ms - gpio_elapsed_ms(&t0);
+			ret = gpiotools_wait_event(gpio_event_fd[pin], left > 0 ? left : 0,
+				&ev);
+			if(ret <= 0)
+				return ret < 0 ? ret : 1;
+		}
+		while(ev.id != (value ? GPIOEVENT_EVENT_RISING_EDGE :
+			GPIOEVENT_EVENT_FALLING_EDGE));
+	}
+	
+	return 0;
+}
+
 /*
  * simplified wrapper for pin write
  */
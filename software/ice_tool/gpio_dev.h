@@ -14,9 +14,18 @@ int gpiotools_request_linehandle(const char *device_name, unsigned int *lines,
 int gpiotools_set_values(const int fd, struct gpiohandle_data *data);
 int gpiotools_get_values(const int fd, struct gpiohandle_data *data);
 int gpiotools_release_linehandle(const int fd);
+int gpiotools_request_lineevent(const char *device_name, unsigned int line,
+				unsigned int handleflags, unsigned int eventflags,
+				const char *consumer_label);
+int gpiotools_wait_event(const int fd, int timeout_ms,
+			 struct gpioevent_data *event);
+
+extern const char *gpio_chip;
+
 int GPIOInit(int nout, unsigned int out_lines[], int nin, unsigned int in_lines[]);
 void GPIOFree(void);
 int GPIORead(int pin);
 int GPIOWrite(int pin, int value);
+int GPIOWaitLevel(int pin, int value, int timeout_ms);
 
 #endif
\ No newline at end of file
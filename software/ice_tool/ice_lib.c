@@ -22,7 +22,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 #include <errno.h>
@@ -31,6 +35,13 @@
 #include "gpio_dev.h"
 
 #define READBUFSIZE 4096
+
+/* DONE timeouts */
+#define ICE_DONE_LOW_MS 10
+#define ICE_DONE_HIGH_MS 10
+
+/* spidev's per-message limit */
+#define SPIDEV_BUFSIZ "/sys/module/spidev/parameters/bufsiz"
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 /* SPI stuff */
@@ -92,7 +103,7 @@ int ice_spi_txrx(iceblk *s, uint8_t *tx, uint8_t *rx, __u32 len)
 		.rx_buf = (unsigned long)rx,
 		.len = len,
 		.delay_usecs = 0,
-		.speed_hz = 15600000,
+		.speed_hz = ICE_REG_HZ,
 		.bits_per_word = 8,
 	};
 	
@@ -125,6 +136,7 @@ iceblk *ice_init(int cfg, int verbose)
 	
 	/* set verbose level */
 	s->verbose = verbose;
+	s->cfg_hz = ICE_CFG_HZ;
     
     /* do we need to configure? */
     s->cfg = cfg;
@@ -181,25 +193,218 @@ fail0:
 	return NULL;
 }
 
-/* Send a bitstream to the FPGA */
-int ice_cfg(iceblk *s, char *bitfile)
+/* set the bitstream load clock */
+int ice_set_cfg_speed(iceblk *s, uint32_t hz)
+{
+	if(hz < 1000000 || hz > ICE_CFG_HZ_MAX)
+	{
+		fprintf(stderr, "ice_set_cfg_speed: %u Hz out of range 1 - %u MHz\n",
+			hz, ICE_CFG_HZ_MAX/1000000);
+		return 1;
+	}
+	s->cfg_hz = hz;
+	return 0;
+}
+
+/* largest single transfer spidev will take */
+static size_t ice_spi_bufsiz(void)
 {
 	FILE *fd;
-    int read;
-	long ct;
-	unsigned char dummybuf[READBUFSIZE];
-	char readbuf[READBUFSIZE];
+	unsigned long bufsiz = READBUFSIZE;
+
+	if((fd = fopen(SPIDEV_BUFSIZ, "r")))
+	{
+		if(fscanf(fd, "%lu", &bufsiz) != 1 || bufsiz == 0)
+			bufsiz = READBUFSIZE;
+		fclose(fd);
+	}
+	return bufsiz;
+}
+
+/* read all of a stream into memory */
+static int ice_read_all(int fd, ice_bitstream *b)
+{
+	size_t size = 0;
+	ssize_t n;
+	uint8_t *p;
+
+	b->data = NULL;
+	b->len = 0;
+	do
+	{
+		if(b->len == size)
+		{
+			size = size ? 2*size : 256*1024;
+			if(!(p = realloc(b->data, size)))
+			{
+				free(b->data);
+				return 1;
+			}
+			b->data = p;
+		}
+		n = read(fd, b->data + b->len, size - b->len);
+		if(n > 0)
+			b->len += n;
+	}
+	while(n > 0 || (n < 0 && errno == EINTR));
 
-	/* open file or return error*/
-	if(!(fd = fopen(bitfile, "r")))
+	if(n < 0)
+	{
+		free(b->data);
+		return 1;
+	}
+	return 0;
+}
+
+/* decompress through an external gzip / xz */
+static int ice_read_filter(iceblk *s, char *bitfile, const char *cmd,
+	ice_bitstream *b)
+{
+	int pfd[2], status, err;
+	pid_t pid;
+
+	qprintf(s, "ice_cfg: decompressing with %s\n\r", cmd);
+	if(pipe(pfd))
+		return 1;
+	if((pid = fork()) < 0)
+	{
+		close(pfd[0]);
+		close(pfd[1]);
+		return 1;
+	}
+	if(pid == 0)
+	{
+		dup2(pfd[1], STDOUT_FILENO);
+		close(pfd[0]);
+		close(pfd[1]);
+		execlp(cmd, cmd, "-dc", "--", bitfile, (char *)NULL);
+		_exit(127);
+	}
+	close(pfd[1]);
+	err = ice_read_all(pfd[0], b);
+	close(pfd[0]);
+	waitpid(pid, &status, 0);
+	if(!err && (!WIFEXITED(status) || WEXITSTATUS(status)))
+	{
+		qprintf(s, "ice_cfg: %s failed on %s\n\r", cmd, bitfile);
+		free(b->data);
+		err = 1;
+	}
+	return err;
+}
+
+/* get a bitstream into memory - mapped if plain, .gz & .xz unpacked */
+int ice_load_bitfile(iceblk *s, char *bitfile, ice_bitstream *b)
+{
+	static const uint8_t gz_magic[] = {0x1f, 0x8b};
+	static const uint8_t xz_magic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+	uint8_t magic[6] = {0, };
+	struct stat st;
+	int fd, err;
+
+	b->mapped = 0;
+	if((fd = open(bitfile, O_RDONLY)) < 0)
 	{
 		qprintf(s, "ice_cfg: open file %s failed\n\r", bitfile);
-		return 0;
+		return 1;
 	}
+	qprintf(s, "ice_cfg: opened bitstream file %s\n\r", bitfile);
+
+	/* compressed? */
+	if(pread(fd, magic, sizeof(magic), 0) >= (ssize_t)sizeof(gz_magic) &&
+		!memcmp(magic, gz_magic, sizeof(gz_magic)))
+	{
+		close(fd);
+		return ice_read_filter(s, bitfile, "gzip", b);
+	}
+	if(!memcmp(magic, xz_magic, sizeof(xz_magic)))
+	{
+		close(fd);
+		return ice_read_filter(s, bitfile, "xz", b);
+	}
+
+	/* plain file - map it */
+	if(!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		b->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+			fd, 0);
+		if(b->data != MAP_FAILED)
+		{
+			b->len = st.st_size;
+			b->mapped = 1;
+			close(fd);
+			return 0;
+		}
+	}
+
+	/* not mappable */
+	err = ice_read_all(fd, b);
+	close(fd);
+	return err;
+}
+
+/* release a loaded bitstream */
+void ice_free_bitfile(ice_bitstream *b)
+{
+	if(b->mapped)
+		munmap(b->data, b->len);
 	else
+		free(b->data);
+	b->data = NULL;
+	b->len = 0;
+}
+
+/* FNV-1a hash of a loaded bitstream */
+uint32_t ice_hash_bitstream(const ice_bitstream *b)
+{
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for(i=0;i<b->len;i++)
+		h = (h ^ b->data[i]) * 16777619U;
+	return h;
+}
+
+/* FNV-1a hash of a bitstream's contents, after any decompression */
+int ice_hash_bitfile(iceblk *s, char *bitfile, uint32_t *hash)
+{
+	ice_bitstream b;
+
+	if(ice_load_bitfile(s, bitfile, &b))
+		return 1;
+	*hash = ice_hash_bitstream(&b);
+	ice_free_bitfile(&b);
+	return 0;
+}
+
+/* Send a bitstream file to the FPGA */
+int ice_cfg(iceblk *s, char *bitfile)
+{
+	ice_bitstream b;
+	int err;
+
+	/* whole bitstream into memory before touching the FPGA */
+	if(ice_load_bitfile(s, bitfile, &b))
 	{
-		qprintf(s, "ice_cfg: opened bitstream file %s\n\r", bitfile);
+		qprintf(s, "ice_cfg: can't load %s\n\r", bitfile);
+		return 1;
 	}
+	err = ice_cfg_bitstream(s, &b);
+	ice_free_bitfile(&b);
+	return err;
+}
+
+/* Send a bitstream already in memory to the FPGA */
+int ice_cfg_bitstream(iceblk *s, const ice_bitstream *b)
+{
+	struct spi_ioc_transfer tr;
+	struct timespec t0, t1;
+	size_t ct, bufsiz, len;
+	uint8_t dummy[10];
+	int err = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	bufsiz = ice_spi_bufsiz();
 
     /* set SS low for spi config */
 	GPIOWrite(SS_IDX, 0);
@@ -210,49 +415,56 @@ int ice_cfg(iceblk *s, char *bitfile)
 	
 	/* Wait for DONE low with timeout */
 	qprintf(s, "ice_cfg: RST low, Waiting for DONE low\n\r");
-	ct = 0;
-	while((GPIORead(DONE_IDX)!=0) && (ct < 1000))
-	{
-		ct++;
-	}
-	if(ct>=1000)
+	if(GPIOWaitLevel(DONE_IDX, 0, ICE_DONE_LOW_MS))
 		qprintf(s, "ice_cfg: Timeout Waiting for DONE low\n\r");
 
 	/* Release RST */
 	GPIOWrite(RST_IDX, 1);
 
-	/* wait 1200us */
+	/* wait 1200us - config memory clear, nothing to watch for this */
 	usleep(1200);
-	qprintf(s, "ice_cfg: Sending bitstream\n\r");
+	qprintf(s, "ice_cfg: Sending %zu bytes at %u Hz, %zu byte transfers\n\r",
+		b->len, s->cfg_hz, bufsiz);
 	
-	/* Read file & send bitstream to FPGA via SPI */
-	ct = 0;
-	while( (read=fread(readbuf, sizeof(char), READBUFSIZE, fd)) > 0 )
+	/* send bitstream to FPGA via SPI, transmit only */
+	memset(&tr, 0, sizeof(tr));
+	tr.speed_hz = s->cfg_hz;
+	tr.bits_per_word = 8;
+	for(ct=0;ct<b->len;ct+=len)
 	{
-		/* Send bitstream */
-		ice_spi_txrx(s, (unsigned char *)readbuf, dummybuf, read);
-		ct += read;
-		
-		/* diagnostic to track buffers */
-		qprintf(s, ".");
-		if(s->verbose)
-			fflush(stdout);
+		len = b->len - ct < bufsiz ? b->len - ct : bufsiz;
+		tr.tx_buf = (unsigned long)(b->data + ct);
+		tr.len = len;
+		if(ioctl(s->spi_file, SPI_IOC_MESSAGE(1), &tr) == -1)
+		{
+			qprintf(s, "ice_cfg: SPI error at byte %zu (%s)\n\r", ct,
+				strerror(errno));
+			err = 1;
+			break;
+		}
 	}
-	
-	/* close file */
-	qprintf(s, "\n\rice_cfg: sent %ld bytes\n\r", ct);
-	qprintf(s, "ice_cfg: bitstream sent, closing file\n\r");
-	fclose(fd);
+	qprintf(s, "ice_cfg: sent %zu bytes\n\r", ct);
 
  	qprintf(s, "ice_cfg: sending dummy clocks\n");
-	memset(readbuf, 0, 10);
-	ice_spi_txrx(s, (unsigned char *)readbuf, dummybuf, 10);
+	memset(dummy, 0, sizeof(dummy));
+	tr.tx_buf = (unsigned long)dummy;
+	tr.len = sizeof(dummy);
+	ioctl(s->spi_file, SPI_IOC_MESSAGE(1), &tr);
 	
     /* set SS high */
 	GPIOWrite(SS_IDX, 1);
+
+	/* DONE rises once the dummy clocks have started the design */
+	if(!err && GPIOWaitLevel(DONE_IDX, 1, ICE_DONE_HIGH_MS) < 0)
+		err = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	s->cfg_ms = (t1.tv_sec - t0.tv_sec) * 1e3F +
+		(t1.tv_nsec - t0.tv_nsec) * 1e-6F;
+	qprintf(s, "ice_cfg: load took %.1f ms\n\r", s->cfg_ms);
     
 	/* return status */
-	if(GPIORead(DONE_IDX)==0)
+	if(err || GPIORead(DONE_IDX)==0)
 	{
 		qprintf(s, "ice_cfg: cfg failed - DONE not high\n\r");
 		return 1;	// Done = 0 - error
@@ -304,6 +516,94 @@ uint8_t ice_write(iceblk *s, uint8_t reg, uint32_t data)
 	return ice_spi_txrx(s, tx, rx, ARRAY_SIZE(tx)) == -1;
 }
 
+/*
+ * start an empty batch
+ */
+void ice_batch_init(ice_batch *b)
+{
+	b->n = 0;
+}
+
+/*
+ * queue a register read - data is filled in by ice_batch_run()
+ */
+uint8_t ice_batch_read(ice_batch *b, uint8_t reg, uint32_t *data)
+{
+	uint8_t *tx;
+
+	if(b->n >= ICE_BATCH_MAX)
+		return 1;
+
+	tx = b->tx[b->n];
+	tx[0] = 0x80 | (reg & 0x7f);	// set address
+	tx[1] = tx[2] = tx[3] = tx[4] = 0;
+	b->data[b->n++] = data;
+
+	return 0;
+}
+
+/*
+ * queue a register write
+ */
+uint8_t ice_batch_write(ice_batch *b, uint8_t reg, uint32_t data)
+{
+	uint8_t *tx;
+
+	if(b->n >= ICE_BATCH_MAX)
+		return 1;
+
+	tx = b->tx[b->n];
+	tx[0] = reg & 0x7f;	// set address
+	tx[1] = (data >> 24) & 0xff;
+	tx[2] = (data >> 16) & 0xff;
+	tx[3] = (data >>  8) & 0xff;
+	tx[4] = (data >>  0) & 0xff;
+	b->data[b->n++] = NULL;
+
+	return 0;
+}
+
+/*
+ * send everything queued as one SPI message, one transfer per access
+ * with chip select released in between so the FPGA sees the same
+ * framing as separate calls. Fills in the reads & empties the batch.
+ */
+uint8_t ice_batch_run(iceblk *s, ice_batch *b)
+{
+	struct spi_ioc_transfer tr[ICE_BATCH_MAX];
+	uint8_t *rx;
+	int i, ret;
+
+	if(!b->n)
+		return 0;
+
+	memset(tr, 0, b->n * sizeof(struct spi_ioc_transfer));
+	for(i=0;i<b->n;i++)
+	{
+		tr[i].tx_buf = (unsigned long)b->tx[i];
+		tr[i].rx_buf = (unsigned long)b->rx[i];
+		tr[i].len = ICE_REG_LEN;
+		tr[i].speed_hz = ICE_REG_HZ;
+		tr[i].bits_per_word = 8;
+		tr[i].cs_change = i < b->n-1;
+	}
+
+	ret = ioctl(s->spi_file, SPI_IOC_MESSAGE(b->n), tr);
+
+	/* assemble results */
+	for(i=0;i<b->n;i++)
+	{
+		if(!b->data[i])
+			continue;
+		rx = b->rx[i];
+		*b->data[i] = ret == -1 ? 0 :
+			(rx[1]<<24) | (rx[2]<<16) | (rx[3]<<8) | rx[4];
+	}
+	b->n = 0;
+
+	return ret == -1;
+}
+
 /* Clean shutdown of our FPGA interface */
 void ice_delete(iceblk *s)
 {
@@ -23,20 +23,60 @@
 #include <stdint.h>
 #include <linux/types.h>
 
+/* max register accesses in one batch */
+#define ICE_BATCH_MAX 16
+
+/* bytes per register access - R/W + address, 32-bit data */
+#define ICE_REG_LEN 5
+
+/* SPI clocks - register access & bitstream load. iCE40 slave config
+   is specified up to 25 MHz */
+#define ICE_REG_HZ 15600000
+#define ICE_CFG_HZ 25000000
+#define ICE_CFG_HZ_MAX 25000000
+
 /* state structure */
 typedef struct
 {
 	int spi_file;		/* SPI device */
     int cfg;            /* GPIO for config is enabled */
 	int verbose;		/* Verbose level */
+	uint32_t cfg_hz;	/* bitstream load SPI clock */
+	float cfg_ms;		/* time taken sending the last bitstream */
 } iceblk;
 
+/* bitstream in memory - mapped file or decompressed copy */
+typedef struct
+{
+	uint8_t *data;
+	size_t len;
+	int mapped;
+} ice_bitstream;
+
+/* queued register accesses for ice_batch_run() */
+typedef struct
+{
+	int n;
+	uint8_t tx[ICE_BATCH_MAX][ICE_REG_LEN];
+	uint8_t rx[ICE_BATCH_MAX][ICE_REG_LEN];
+	uint32_t *data[ICE_BATCH_MAX];	/* read destinations, NULL for writes */
+} ice_batch;
+
 int ice_spi_txrx(iceblk *s, uint8_t *tx, uint8_t *rx, __u32 len);
 iceblk *ice_init(int cfg, int verbose);
-FILE *ice_open_bitfile(iceblk *s, char *bitfile, long *n);
+int ice_set_cfg_speed(iceblk *s, uint32_t hz);
+int ice_load_bitfile(iceblk *s, char *bitfile, ice_bitstream *b);
+void ice_free_bitfile(ice_bitstream *b);
+uint32_t ice_hash_bitstream(const ice_bitstream *b);
+int ice_hash_bitfile(iceblk *s, char *bitfile, uint32_t *hash);
 int ice_cfg(iceblk *s, char *bitfile);
+int ice_cfg_bitstream(iceblk *s, const ice_bitstream *b);
 uint8_t ice_read(iceblk *s, uint8_t reg, uint32_t *data);
 uint8_t ice_write(iceblk *s, uint8_t reg, uint32_t data);
+void ice_batch_init(ice_batch *b);
+uint8_t ice_batch_read(ice_batch *b, uint8_t reg, uint32_t *data);
+uint8_t ice_batch_write(ice_batch *b, uint8_t reg, uint32_t data);
+uint8_t ice_batch_run(iceblk *s, ice_batch *b);
 void ice_delete(iceblk *s);
 
 #endif
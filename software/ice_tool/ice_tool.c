@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include "ice_lib.h"
+#include "gpio_dev.h"
 
 #define VERSION "0.1"
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
@@ -29,10 +30,13 @@ static void help(void) __attribute__ ((noreturn));
 static void help(void)
 {
 	fprintf(stderr,
-	    "Usage: ice_tool [-r addr][-w addr data][-v][-V] [BITSTREAM] \n"
-		"  BITSTREAM is a file containing the FPGA bitstream to download\n"
+	    "Usage: ice_tool [-r addr][-w addr data][-s Hz][-c chip][-v][-V] [BITSTREAM] \n"
+		"  BITSTREAM is a file containing the FPGA bitstream to download,\n"
+		"    optionally gzip or xz compressed\n"
 		"  -r read SPI control port at addr\n"
 		"  -w write SPI control port at addr w/ data\n"
+		"  -s bitstream SPI clock in Hz, up to 25000000\n"
+		"  -c GPIO chip for the config pins, default gpiochip0\n"
 		"  -v enables verbose progress messages\n"
 		"  -V prints the tool version\n");
 	exit(1);
@@ -43,6 +47,7 @@ int main(int argc, char **argv)
 	iceblk *bs;
 	int flags = 0, read = 0, write = 0, verbose = 0, cfg = 0;
 	int addr = 0, data = 0;
+	uint32_t speed = ICE_CFG_HZ;
 
 	/* handle (optional) flags first */
 	while (1+flags < argc && argv[1+flags][0] == '-')
@@ -63,6 +68,16 @@ int main(int argc, char **argv)
 				data = atoi(argv[flags+3]);
 			flags+=2;
 			break;
+		case 's':
+			if (2+flags < argc)
+				speed = strtoul(argv[flags+2], NULL, 0);
+			flags++;
+			break;
+		case 'c':
+			if (2+flags < argc)
+				gpio_chip = argv[flags+2];
+			flags++;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -95,10 +110,12 @@ int main(int argc, char **argv)
         /* Configure FPGA */
         if(verbose == 1) fprintf(stderr, "Configuring FPGA...\n");
 
-        if(ice_cfg(bs, argv[flags + 1]))
+        if(ice_set_cfg_speed(bs, speed) || ice_cfg(bs, argv[flags + 1]))
         {
             fprintf(stderr, "Error sending bitstream to FPGA\n");
         }
+        else
+            fprintf(stderr, "FPGA configured in %.1f ms\n", bs->cfg_ms);
 	}
 
 	/* spi read/write? */
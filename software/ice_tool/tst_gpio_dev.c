@@ -1,11 +1,18 @@
 /*
  * tst_gpio_dev.c - test GPIO char dev lib
  * 06-21-2020 E. Brombaugh
+ *
+ * Edge waits can be checked without hardware on a gpio-sim bank of 32
+ * lines, driving DONE through its pull attribute:
+ *   tst_gpio_dev -c gpiochip1 \
+ *     -s /sys/devices/platform/gpio-sim.0/gpiochip1/sim_gpio23/pull
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include "gpio_dev.h"
 
 enum gpios
@@ -44,15 +51,113 @@ void waitkey(void)
 #define wait usleep(100000)
 #endif
 
+/*
+ * drive the simulated DONE input - gpio-sim "pull" attribute or a
+ * gpio-mockup debugfs line file
+ */
+int sim_set(char *path, int value)
+{
+	FILE *fd;
+	int len = strlen(path);
+	
+	if(!(fd = fopen(path, "w")))
+	{
+		perror(path);
+		return 1;
+	}
+	if(len >= 4 && !strcmp(path + len - 4, "pull"))
+		fprintf(fd, value ? "pull-up" : "pull-down");
+	else
+		fprintf(fd, "%d", value);
+	return fclose(fd) != 0;
+}
+
+/*
+ * wait for DONE edges, driven from sim_path if given
+ */
+int edge_test(char *sim_path, int count)
+{
+	struct timespec t0, t1;
+	int value, ret, fail = 0;
+	
+	value = GPIORead(0);
+	fprintf(stdout, "DONE = %d\n", value);
+	
+	while(count--)
+	{
+		value = !value;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if(sim_path && sim_set(sim_path, value))
+			return 1;
+		ret = GPIOWaitLevel(0, value, sim_path ? 100 : 5000);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fprintf(stdout, "wait for %d: %s, %ld us\n", value,
+			ret < 0 ? "error" : ret ? "timeout" : "ok",
+			(t1.tv_sec - t0.tv_sec) * 1000000 +
+			(t1.tv_nsec - t0.tv_nsec) / 1000);
+		fail |= ret != 0;
+		
+		/* a timeout wait must not return early */
+		if(sim_path && GPIOWaitLevel(0, !value, 20) != 1)
+		{
+			fprintf(stdout, "wait for %d returned before timeout\n", !value);
+			fail = 1;
+		}
+	}
+	
+	return fail;
+}
+
 int main(int argc, char **argv)
 {
-	int count = 10;
+	int count = 10, edges = 0, opt, ret = 0;
+	char *sim_path = NULL;
+	
+	/* parse options */
+	while((opt = getopt(argc, argv, "c:es:n:h")) != EOF)
+	{
+		switch(opt)
+		{
+			case 'c':
+				gpio_chip = optarg;
+				break;
+			
+			case 'e':
+				edges = 1;
+				break;
+			
+			case 's':
+				sim_path = optarg;
+				edges = 1;
+				break;
+			
+			case 'n':
+				count = atoi(optarg);
+				break;
+			
+			default:
+				fprintf(stderr, "USAGE: %s [-c chip] [-e] [-s sim file] [-n count]\n"
+					"  -c gpiochip name, default gpiochip0\n"
+					"  -e wait for edges on DONE instead of toggling outputs\n"
+					"  -s drive DONE via gpio-sim pull or gpio-mockup file\n"
+					"  -n iterations, default 10\n", argv[0]);
+				exit(1);
+		}
+	}
 	
 	if(GPIOInit(2, out_lines, 1, in_lines))
 	{
 		fprintf(stderr, "Couldn't init GPIO\n");
 		exit(1);
 	}
+	
+	if(edges)
+	{
+		ret = edge_test(sim_path, count);
+		fprintf(stdout, "%s\n", ret ? "FAIL" : "PASS");
+		GPIOFree();
+		return ret;
+	}
 
 	while(count--)
 	{
@@ -68,4 +173,5 @@ int main(int argc, char **argv)
 	}
 	
 	GPIOFree();
-}
\ No newline at end of file
+	return ret;
+}